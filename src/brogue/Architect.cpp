@@ -23,6 +23,7 @@
 
 #include "IncludeGlobals.h"
 #include "Rogue.h"
+#include "Grid.h"
 
 int topBlobMinX, topBlobMinY, blobWidth, blobHeight;
 
@@ -30,6 +31,7 @@ int topBlobMinX, topBlobMinY, blobWidth, blobHeight;
 bool cellHasTerrainFlag(int x, int y, unsigned long flagMask)
 {
   assert(coordinatesAreInMap(x, y));
+  assert(!terrainFlagCache.valid || terrainFlagCache.flags[x][y] == layerTerrainFlags(x, y));
   return ((flagMask)&terrainFlags((x), (y)) ? true : false);
 }
 #endif
@@ -140,24 +142,40 @@ void auditLoop(int x, int y, char grid[DCOLS][DROWS])
 // included an area machine.
 int floodFillCount(char results[DCOLS][DROWS], char passMap[DCOLS][DROWS], int startX, int startY)
 {
-  int dir, newX, newY, count;
+  CellSet region, passable;
+  int i, j, count = 0;
 
-  count = (passMap[startX][startY] == 2 ? 5000 : 1);
-
-  if (pmap[startX][startY].flags & IS_IN_AREA_MACHINE)
+  passable.clear();
+  for (i = 0; i < DCOLS; i++)
   {
-    count = 10000;
+    for (j = 0; j < DROWS; j++)
+    {
+      if (passMap[i][j] && !results[i][j])
+      {
+        passable.add(i, j);
+      }
+    }
   }
+  region.clear();
+  region.add(startX, startY);
+  floodCellSet(&region, &passable);
 
-  results[startX][startY] = true;
-
-  for (dir = 0; dir < 4; dir++)
+  for (i = 0; i < DCOLS; i++)
   {
-    newX = startX + nbDirs[dir][0];
-    newY = startY + nbDirs[dir][1];
-    if (coordinatesAreInMap(newX, newY) && passMap[newX][newY] && !results[newX][newY])
+    for (j = 0; j < DROWS; j++)
     {
-      count += floodFillCount(results, passMap, newX, newY);
+      if (region.contains(i, j))
+      {
+        results[i][j] = true;
+        if (pmap[i][j].flags & IS_IN_AREA_MACHINE)
+        {
+          count += 10000;
+        }
+        else
+        {
+          count += (passMap[i][j] == 2 ? 5000 : 1);
+        }
+      }
     }
   }
   return min(count, 10000);
@@ -3042,36 +3060,26 @@ void fillLake(int x, int y, int liquid, int scanWidth, char wreathMap[DCOLS][DRO
   }
 }
 
-void lakeFloodFill(int x, int y, int** floodMap, int** grid, int** lakeMap, int dungeonToGridX,
-                   int dungeonToGridY)
+bool lakeDisruptsPassability(int** grid, int** lakeMap, int dungeonToGridX, int dungeonToGridY)
 {
-  int newX, newY;
-  enum Directions dir;
+  bool result;
+  int i, j, x, y;
+  CellSet floodMap, floodable;
 
-  floodMap[x][y] = true;
-  for (dir = 0; dir < 4; dir++)
+  floodable.clear();
+  for (i = 0; i < DCOLS; i++)
   {
-    newX = x + nbDirs[dir][0];
-    newY = y + nbDirs[dir][1];
-    if (coordinatesAreInMap(newX, newY) && !floodMap[newX][newY] &&
-        (!cellHasTerrainFlag(newX, newY, T_PATHING_BLOCKER) || cellHasTMFlag(newX, newY, TM_CONNECTS_LEVEL)) &&
-        !lakeMap[newX][newY] &&
-        (!coordinatesAreInMap(newX + dungeonToGridX, newY + dungeonToGridY) ||
-         !grid[newX + dungeonToGridX][newY + dungeonToGridY]))
+    for (j = 0; j < DROWS; j++)
     {
-      lakeFloodFill(newX, newY, floodMap, grid, lakeMap, dungeonToGridX, dungeonToGridY);
+      if ((!cellHasTerrainFlag(i, j, T_PATHING_BLOCKER) || cellHasTMFlag(i, j, TM_CONNECTS_LEVEL)) &&
+          !lakeMap[i][j] &&
+          (!coordinatesAreInMap(i + dungeonToGridX, j + dungeonToGridY) ||
+           !grid[i + dungeonToGridX][j + dungeonToGridY]))
+      {
+        floodable.add(i, j);
+      }
     }
   }
-}
-
-bool lakeDisruptsPassability(int** grid, int** lakeMap, int dungeonToGridX, int dungeonToGridY)
-{
-  bool result;
-  int i, j, x, y;
-  int** floodMap;
-
-  floodMap = allocGrid();
-  fillGrid(floodMap, 0);
   x = y = -1;
   // Get starting location for the fill.
   for (i = 0; i < DCOLS && x == -1; i++)
@@ -3089,7 +3097,9 @@ bool lakeDisruptsPassability(int** grid, int** lakeMap, int dungeonToGridX, int
   }
   brogueAssert(x != -1);
   // Do the flood fill.
-  lakeFloodFill(x, y, floodMap, grid, lakeMap, dungeonToGridX, dungeonToGridY);
+  floodMap.clear();
+  floodMap.add(x, y);
+  floodCellSet(&floodMap, &floodable);
 
   // See if any dry tiles weren't reached by the flood fill.
   result = false;
@@ -3097,7 +3107,7 @@ bool lakeDisruptsPassability(int** grid, int** lakeMap, int dungeonToGridX, int
   {
     for (j = 0; j < DROWS && result == false; j++)
     {
-      if (!cellHasTerrainFlag(i, j, T_PATHING_BLOCKER) && !lakeMap[i][j] && !floodMap[i][j] &&
+      if (!cellHasTerrainFlag(i, j, T_PATHING_BLOCKER) && !lakeMap[i][j] && !floodMap.contains(i, j) &&
           (!coordinatesAreInMap(i + dungeonToGridX, j + dungeonToGridY) ||
            !grid[i + dungeonToGridX][j + dungeonToGridY]))
       {
@@ -3115,7 +3125,6 @@ bool lakeDisruptsPassability(int** grid, int** lakeMap, int dungeonToGridX, int
     }
   }
 
-  freeGrid(floodMap);
   return result;
 }
 
@@ -3406,6 +3415,7 @@ void digDungeon()
 
   int** grid;
 
+  invalidateTerrainFlags();  // startLevel() rebuilds it once the level is finished
   rogue.machineNumber = 0;
 
   topBlobMinX = topBlobMinY = blobWidth = blobHeight = 0;
@@ -3560,15 +3570,11 @@ void updateMapToShore()
   freeGrid(costMap);
 }
 
-// Calculates the distance map for the given waypoint.
-// This is called on all waypoints during setUpWaypoints(),
-// and then one waypoint is recalculated per turn thereafter.
-void refreshWaypoint(int wpIndex)
+// The costs that waypoint distance maps are scanned over.
+static void populateWaypointCostMap(int** costMap)
 {
-  int** costMap;
   Creature* monst;
 
-  costMap = allocGrid();
   populateGenericCostMap(costMap);
   for (monst = monsters->nextCreature; monst != nullptr; monst = monst->nextCreature)
   {
@@ -3579,16 +3585,31 @@ void refreshWaypoint(int wpIndex)
       costMap[monst->xLoc][monst->yLoc] = PDS_FORBIDDEN;
     }
   }
+}
+
+static void seedWaypoint(int wpIndex)
+{
   fillGrid(rogue.wpDistance[wpIndex], 30000);
   rogue.wpDistance[wpIndex][rogue.wpCoordinates[wpIndex][0]][rogue.wpCoordinates[wpIndex][1]] = 0;
+}
+
+// Calculates the distance map for the given waypoint.
+// setUpWaypoints() calculates all of them at once,
+// and then one waypoint is recalculated per turn thereafter.
+void refreshWaypoint(int wpIndex)
+{
+  Grid<int> costMap;
+
+  populateWaypointCostMap(costMap);
+  seedWaypoint(wpIndex);
   dijkstraScan(rogue.wpDistance[wpIndex], costMap, true);
-  freeGrid(costMap);
 }
 
 void setUpWaypoints()
 {
   int i, j, sCoord[DCOLS * DROWS], x, y;
   char grid[DCOLS][DROWS];
+  Grid<int> costMap;
 
   zeroOutGrid(grid);
   for (i = 0; i < DCOLS; i++)
@@ -3623,14 +3644,17 @@ void setUpWaypoints()
     }
   }
 
+  // Every waypoint's map is scanned over the same costs, so build them once and scan them all together.
+  populateWaypointCostMap(costMap);
   for (i = 0; i < rogue.wpCount; i++)
   {
-    refreshWaypoint(i);
+    seedWaypoint(i);
     //        blackOutScreen();
     //        dumpLevelToScreen();
     //        displayGrid(rogue.wpDistance[i]);
     //        temporaryMessage("Waypoint distance map:", true);
   }
+  dijkstraScanBatch(rogue.wpDistance, rogue.wpCount, costMap, true);
 }
 
 void zeroOutGrid(char grid[DCOLS][DROWS])
@@ -3672,29 +3696,28 @@ int oppositeDirection(int theDir)
   }
 }
 
-// blockingMap is optional.
-// Returns the size of the connected zone, and marks visited[][] with the
-// zoneLabel.
-int connectCell(int x, int y, int zoneLabel, char blockingMap[DCOLS][DROWS], char zoneMap[DCOLS][DROWS])
+// Labels the zone of open cells around (x, y) in zoneMap with zoneLabel, takes it out of open,
+// and returns its size.
+static int labelZone(int x, int y, int zoneLabel, CellSet* open, char zoneMap[DCOLS][DROWS])
 {
-  enum Directions dir;
-  int newX, newY, size;
-
-  zoneMap[x][y] = zoneLabel;
-  size = 1;
+  CellSet zone;
+  int i, j;
 
-  for (dir = 0; dir < 4; dir++)
+  zone.clear();
+  zone.add(x, y);
+  floodCellSet(&zone, open);
+  for (i = 0; i < DCOLS; i++)
   {
-    newX = x + nbDirs[dir][0];
-    newY = y + nbDirs[dir][1];
-
-    if (coordinatesAreInMap(newX, newY) && zoneMap[newX][newY] == 0 && (!blockingMap || !blockingMap[newX][newY]) &&
-        cellIsPassableOrDoor(newX, newY))
+    open->columns[i] &= ~zone.columns[i];
+    for (j = 0; j < DROWS; j++)
     {
-      size += connectCell(newX, newY, zoneLabel, blockingMap, zoneMap);
+      if (zone.contains(i, j))
+      {
+        zoneMap[i][j] = zoneLabel;
+      }
     }
   }
-  return size;
+  return zone.count();
 }
 
 // Make a zone map of connected passable regions that include at least one
@@ -3708,11 +3731,23 @@ int connectCell(int x, int y, int zoneLabel, char blockingMap[DCOLS][DROWS], cha
 int levelIsDisconnectedWithBlockingMap(char blockingMap[DCOLS][DROWS], bool countRegionSize)
 {
   char zoneMap[DCOLS][DROWS];
+  CellSet open;
   int i, j, dir, zoneSizes[200], zoneCount, smallestQualifyingZoneSize, borderingZone;
 
   zoneCount = 0;
   smallestQualifyingZoneSize = 10000;
   zeroOutGrid(zoneMap);
+  open.clear();
+  for (i = 0; i < DCOLS; i++)
+  {
+    for (j = 0; j < DROWS; j++)
+    {
+      if (cellIsPassableOrDoor(i, j) && !blockingMap[i][j])
+      {
+        open.add(i, j);
+      }
+    }
+  }
 
   //	dumpLevelToScreen();
   //	hiliteCharGrid(blockingMap, &omniscienceColor, 100);
@@ -3730,7 +3765,7 @@ int levelIsDisconnectedWithBlockingMap(char blockingMap[DCOLS][DROWS], bool coun
           if (blockingMap[i + nbDirs[dir][0]][j + nbDirs[dir][1]])
           {
             zoneCount++;
-            zoneSizes[zoneCount - 1] = connectCell(i, j, zoneCount, blockingMap, zoneMap);
+            zoneSizes[zoneCount - 1] = labelZone(i, j, zoneCount, &open, zoneMap);
             break;
           }
         }
@@ -3739,6 +3774,17 @@ int levelIsDisconnectedWithBlockingMap(char blockingMap[DCOLS][DROWS], bool coun
   }
 
   // Expand the zones into the blocking area.
+  open.clear();
+  for (i = 0; i < DCOLS; i++)
+  {
+    for (j = 0; j < DROWS; j++)
+    {
+      if (cellIsPassableOrDoor(i, j) && zoneMap[i][j] == 0)
+      {
+        open.add(i, j);
+      }
+    }
+  }
   for (i = 1; i < DCOLS - 1; i++)
   {
     for (j = 1; j < DROWS - 1; j++)
@@ -3750,7 +3796,7 @@ int levelIsDisconnectedWithBlockingMap(char blockingMap[DCOLS][DROWS], bool coun
           borderingZone = zoneMap[i + nbDirs[dir][0]][j + nbDirs[dir][1]];
           if (borderingZone != 0)
           {
-            connectCell(i, j, borderingZone, nullptr, zoneMap);
+            labelZone(i, j, borderingZone, &open, zoneMap);
             break;
           }
         }
@@ -3838,6 +3884,7 @@ bool fillSpawnMap(enum dungeonLayers layer, enum TileType surfaceTileType, char
         }
 
         pmap[i][j].layers[layer] = surfaceTileType;  // Place the terrain!
+        updateTerrainFlags(i, j);
         accomplishedSomething = true;
 
         if (refresh)
@@ -3996,6 +4043,7 @@ bool spawnDungeonFeature(int x, int y, DungeonFeature* feat, bool refreshCell, b
     {
       pmap[x][y].volume += feat->startProbability;
       pmap[x][y].layers[GAS] = feat->tile;
+      updateTerrainFlags(x, y);
       if (refreshCell)
       {
         refreshDungeonCell(x, y);
@@ -4056,6 +4104,7 @@ bool spawnDungeonFeature(int x, int y, DungeonFeature* feat, bool refreshCell, b
               pmap[i][j].layers[layer] = (layer == DUNGEON ? FLOOR : NOTHING);
             }
           }
+          updateTerrainFlags(i, j);
         }
       }
     }
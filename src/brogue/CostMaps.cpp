@@ -0,0 +1,172 @@
+/*
+ *  CostMaps.cpp
+ *  Brogue++
+ *
+ *  Written by Jason I Mercer
+ *
+ *  Based on code and ideas by Brian Walker
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "IncludeGlobals.h"
+#include "Rogue.h"
+#include "Grid.h"
+
+#define COST_MAP_CACHE_SIZE 8
+
+// A cost map that was asked for before, and the cells of it that have gone stale since: everything
+// between (dirtyLeft, dirtyTop) and (dirtyRight, dirtyBottom), or nothing if dirtyLeft > dirtyRight.
+struct CostMapEntry
+{
+  CostMapProfile profile;
+  Grid<int> costs;
+  bool used;
+  unsigned long lastUse;
+  int dirtyLeft, dirtyTop, dirtyRight, dirtyBottom;
+};
+
+static thread_local CostMapEntry costMapCache[COST_MAP_CACHE_SIZE];
+static thread_local unsigned long costMapClock;
+
+static bool sameProfile(const CostMapProfile* a, const CostMapProfile* b)
+{
+  return a->kind == b->kind && a->blockingTerrainFlags == b->blockingTerrainFlags &&
+         a->canUseSecretDoors == b->canUseSecretDoors && a->discoveredOnly == b->discoveredOnly;
+}
+
+static void dirtyWholeEntry(CostMapEntry* entry)
+{
+  entry->dirtyLeft = 0;
+  entry->dirtyTop = 0;
+  entry->dirtyRight = DCOLS - 1;
+  entry->dirtyBottom = DROWS - 1;
+}
+
+static int genericCost(int x, int y)
+{
+  if (cellHasTerrainFlag(x, y, T_OBSTRUCTS_PASSABILITY) &&
+      (!cellHasTMFlag(x, y, TM_IS_SECRET) || (discoveredTerrainFlagsAtLoc(x, y) & T_OBSTRUCTS_PASSABILITY)))
+  {
+    return cellHasTerrainFlag(x, y, T_OBSTRUCTS_DIAGONAL_MOVEMENT) ? PDS_OBSTRUCTION : PDS_FORBIDDEN;
+  }
+  else if (cellHasTerrainFlag(x, y, T_PATHING_BLOCKER & ~T_OBSTRUCTS_PASSABILITY))
+  {
+    return PDS_FORBIDDEN;
+  }
+  return 1;
+}
+
+// What calculateDistances() makes of a cell before it asks the traveler.
+static int travelCost(const CostMapProfile* profile, int x, int y)
+{
+  if (profile->canUseSecretDoors && cellHasTMFlag(x, y, TM_IS_SECRET) &&
+      cellHasTerrainFlag(x, y, T_OBSTRUCTS_PASSABILITY) &&
+      !(discoveredTerrainFlagsAtLoc(x, y) & T_OBSTRUCTS_PASSABILITY))
+  {
+    return 1;
+  }
+  else if (cellHasTerrainFlag(x, y, T_OBSTRUCTS_PASSABILITY) ||
+           (profile->discoveredOnly && !(pmap[x][y].flags & (DISCOVERED | MAGIC_MAPPED))))
+  {
+    return cellHasTerrainFlag(x, y, T_OBSTRUCTS_DIAGONAL_MOVEMENT) ? PDS_OBSTRUCTION : PDS_FORBIDDEN;
+  }
+  else if (cellHasTerrainFlag(x, y, profile->blockingTerrainFlags))
+  {
+    return PDS_FORBIDDEN;
+  }
+  return COST_UNLESS_AVOIDED;
+}
+
+static void refreshEntry(CostMapEntry* entry)
+{
+  int i, j;
+
+  for (i = entry->dirtyLeft; i <= entry->dirtyRight; i++)
+  {
+    for (j = entry->dirtyTop; j <= entry->dirtyBottom; j++)
+    {
+      entry->costs[i][j] =
+          (entry->profile.kind == GENERIC_COST_MAP ? genericCost(i, j) : travelCost(&entry->profile, i, j));
+    }
+  }
+  entry->dirtyLeft = DCOLS;
+  entry->dirtyTop = DROWS;
+  entry->dirtyRight = -1;
+  entry->dirtyBottom = -1;
+}
+
+// The terrain's part of the cost map for a profile, brought up to date. Maps that are asked for again
+// are kept, and only the cells that changed since are worked out afresh. While the terrain flags
+// aren't being kept (during level generation) nothing reports changes, so the map is worked out whole
+// and left stale. The grid belongs to the cache: read it before the next call.
+int** cachedCostMap(const CostMapProfile* profile)
+{
+  CostMapEntry* entry = nullptr;
+  int i;
+
+  for (i = 0; i < COST_MAP_CACHE_SIZE && entry == nullptr; i++)
+  {
+    if (costMapCache[i].used && sameProfile(&costMapCache[i].profile, profile))
+    {
+      entry = &costMapCache[i];
+    }
+  }
+  if (entry == nullptr)
+  {
+    entry = &costMapCache[0];
+    for (i = 1; i < COST_MAP_CACHE_SIZE; i++)
+    {
+      if (!costMapCache[i].used || (entry->used && costMapCache[i].lastUse < entry->lastUse))
+      {
+        entry = &costMapCache[i];
+      }
+    }
+    entry->profile = *profile;
+    entry->used = true;
+    dirtyWholeEntry(entry);
+  }
+
+  entry->lastUse = ++costMapClock;
+  refreshEntry(entry);
+  if (!terrainFlagCache.valid)
+  {
+    dirtyWholeEntry(entry);
+  }
+  return entry->costs;
+}
+
+// Call after changing the terrain of (x, y), or whether it has been discovered.
+void markCostMapsDirty(int x, int y)
+{
+  CostMapEntry* entry;
+
+  for (entry = costMapCache; entry < costMapCache + COST_MAP_CACHE_SIZE; entry++)
+  {
+    entry->dirtyLeft = min(entry->dirtyLeft, x);
+    entry->dirtyTop = min(entry->dirtyTop, y);
+    entry->dirtyRight = max(entry->dirtyRight, x);
+    entry->dirtyBottom = max(entry->dirtyBottom, y);
+  }
+}
+
+void invalidateCostMaps()
+{
+  CostMapEntry* entry;
+
+  for (entry = costMapCache; entry < costMapCache + COST_MAP_CACHE_SIZE; entry++)
+  {
+    dirtyWholeEntry(entry);
+  }
+}
@@ -23,146 +23,186 @@
 // This code was created by Joshua Day, to replace my clunkier and slower Dijkstra scanning algorithm in Movement.c.
 // Thanks very much, Joshua.
 
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
 #include "IncludeGlobals.h"
 #include "Rogue.h"
+#include "Grid.h"
+
+#define PDS_CELLS (DCOLS * DROWS)
 
-struct pdsLink
+// A cell of one lane waiting to be scanned from. Entries number the cells of lane l from
+// l * PDS_CELLS, so one queue can hold the cells of every lane.
+struct pdsSource
 {
   int distance;
-  int cost;
-  pdsLink *left, *right;
+  int entry;
 };
 
+// Distances are settled by a bucket queue (Dial's algorithm) rather than a sorted list: costs are
+// small integers, so every cell still waiting to be scanned is within the largest cost of the one
+// being scanned, and a ring of that many buckets orders them without any searching. Ties are
+// scanned in whatever order they were queued, which can't change the distances that come out.
+//
+// A map can hold several lanes of distances over the same costs, each scanned as if on its own; the
+// batch calls below settle all of them in one pass over the ring.
 struct pdsMap
 {
   bool eightWays;
 
-  pdsLink front;
-  pdsLink links[DCOLS * DROWS];
+  int costs[PDS_CELLS];            // indexed by PDS_CELL()
+  std::vector<int> distances;      // PDS_CELLS per lane
+  std::vector<pdsSource> sources;  // entries given a distance since the last update, to scan from
+  std::vector<std::vector<int>> ring;  // bucket (distance & (ring.size() - 1)) holds entries to scan at that distance
+  std::vector<int> seeds;              // the starting distances of the last dijkstraRepairScan(), if any
+
+  // dijkstraRepairScan()'s scratch, kept from one call to the next so that it allocates nothing.
+  std::vector<int> oldCosts;   // the costs of the last scan
+  std::vector<int> newSeeds;   // the starting distances of this scan, swapped into seeds at the end
+  std::vector<char> affected;  // whether each cell is in repairs
+  std::vector<int> repairs;    // the cells that start over
 };
 
+pdsMap* allocPdsMap()
+{
+  pdsMap* map = new pdsMap;
+  map->distances.resize(PDS_CELLS);
+  return map;
+}
+
+void freePdsMap(pdsMap* map)
+{
+  delete map;
+}
+
+static void pdsSetLaneCount(pdsMap* map, int laneCount)
+{
+  map->distances.resize((size_t)laneCount * PDS_CELLS);
+}
+
+static bool sourceIsCloser(const pdsSource& a, const pdsSource& b)
+{
+  return a.distance < b.distance;
+}
+
 void pdsUpdate(pdsMap* map)
 {
-  int dir, dirs;
-  pdsLink *left = nullptr, *right = nullptr, *link = nullptr;
+  const int dirs = map->eightWays ? 8 : 4;
+  int i, k, dir, entry, cell, lane, neighbor, distance, maxCost, queued;
+  int* distances;
+  size_t ringSize, mask, nextSource;
 
-  dirs = map->eightWays ? 8 : 4;
+  if (map->sources.empty())
+  {
+    return;
+  }
 
-  pdsLink* head = map->front.right;
-  map->front.right = nullptr;
+  maxCost = 0;
+  for (i = 0; i < PDS_CELLS; i++)
+  {
+    maxCost = max(maxCost, map->costs[i]);
+  }
+  for (ringSize = 1; ringSize <= (size_t)maxCost; ringSize <<= 1)
+    ;
+  if (map->ring.size() < ringSize)
+  {
+    map->ring.resize(ringSize);
+  }
+  mask = map->ring.size() - 1;
 
-  while (head != nullptr)
+  std::sort(map->sources.begin(), map->sources.end(), sourceIsCloser);
+
+  distances = map->distances.data();
+  nextSource = 0;
+  queued = 0;
+  distance = map->sources[0].distance;
+  while (nextSource < map->sources.size() || queued > 0)
   {
-    for (dir = 0; dir < dirs; dir++)
+    if (queued == 0)
     {
-      link = head + (nbDirs[dir][0] + DCOLS * nbDirs[dir][1]);
-      if (link < map->links || link >= map->links + DCOLS * DROWS)
-        continue;
+      distance = map->sources[nextSource].distance;  // nothing in the ring; skip ahead to the next source
+    }
+    for (; nextSource < map->sources.size() && map->sources[nextSource].distance == distance; nextSource++)
+    {
+      map->ring[distance & mask].push_back(map->sources[nextSource].entry);
+      queued++;
+    }
 
-      // verify passability
-      if (link->cost < 0)
-        continue;
-      if (dir >= 4)
+    std::vector<int>& bucket = map->ring[distance & mask];
+    for (k = 0; k < (int)bucket.size(); k++)  // zero-cost cells join the bucket being scanned
+    {
+      entry = bucket[k];
+      if (distances[entry] != distance)
       {
-        pdsLink *way1, *way2;
-        way1 = head + nbDirs[dir][0];
-        way2 = head + DCOLS * nbDirs[dir][1];
-        if (way1->cost == PDS_OBSTRUCTION || way2->cost == PDS_OBSTRUCTION)
-          continue;
+        continue;  // reached more cheaply after it was queued
       }
-
-      if (head->distance + link->cost < link->distance)
+      cell = entry % PDS_CELLS;
+      lane = entry - cell;
+      for (dir = 0; dir < dirs; dir++)
       {
-        link->distance = head->distance + link->cost;
-
-        // reinsert the touched cell; it'll be close to the beginning of the list now, so
-        // this will be very fast.  start by removing it.
+        neighbor = cell + nbDirs[dir][0] + DCOLS * nbDirs[dir][1];
+        if (neighbor < 0 || neighbor >= PDS_CELLS)
+          continue;
 
-        if (link->right != nullptr)
-          link->right->left = link->left;
-        if (link->left != nullptr)
-          link->left->right = link->right;
+        // verify passability
+        if (map->costs[neighbor] < 0)
+          continue;
+        if (dir >= 4)
+        {
+          const int way1 = cell + nbDirs[dir][0], way2 = cell + DCOLS * nbDirs[dir][1];
+          if ((way1 >= 0 && map->costs[way1] == PDS_OBSTRUCTION) ||
+              (way2 < PDS_CELLS && map->costs[way2] == PDS_OBSTRUCTION))
+            continue;
+        }
 
-        left = head;
-        right = head->right;
-        while (right != nullptr && right->distance < link->distance)
+        if (distance + map->costs[neighbor] < distances[lane + neighbor])
         {
-          left = right;
-          right = right->right;
+          distances[lane + neighbor] = distance + map->costs[neighbor];
+          map->ring[distances[lane + neighbor] & mask].push_back(lane + neighbor);
+          queued++;
         }
-        if (left != nullptr)
-          left->right = link;
-        link->right = right;
-        link->left = left;
-        if (right != nullptr)
-          right->left = link;
       }
     }
-
-    right = head->right;
-
-    head->left = nullptr;
-    head->right = nullptr;
-
-    head = right;
+    queued -= (int)bucket.size();
+    bucket.clear();
+    distance++;
   }
+  map->sources.clear();
 }
 
 void pdsClear(pdsMap* map, int maxDistance, bool eightWays)
 {
-  int i;
-
   map->eightWays = eightWays;
 
-  map->front.right = nullptr;
-
-  for (i = 0; i < DCOLS * DROWS; i++)
-  {
-    map->links[i].distance = maxDistance;
-    map->links[i].left = map->links[i].right = nullptr;
-  }
+  map->sources.clear();
+  pdsSetLaneCount(map, 1);
+  std::fill(map->distances.begin(), map->distances.end(), maxDistance);
 }
 
 int pdsGetDistance(pdsMap* map, int x, int y)
 {
   pdsUpdate(map);
-  return PDS_CELL(map, x, y)->distance;
+  return map->distances[PDS_CELL(x, y)];
 }
 
-void pdsSetDistance(pdsMap* map, int x, int y, int distance)
+static void pdsSetLaneDistance(pdsMap* map, int lane, int x, int y, int distance)
 {
-  pdsLink *left, *right, *link;
+  const int entry = lane * PDS_CELLS + PDS_CELL(x, y);
 
-  if (x > 0 && y > 0 && x < DCOLS - 1 && y < DROWS - 1)
+  if (x > 0 && y > 0 && x < DCOLS - 1 && y < DROWS - 1 && map->distances[entry] > distance)
   {
-    link = PDS_CELL(map, x, y);
-    if (link->distance > distance)
-    {
-      link->distance = distance;
-
-      if (link->right != nullptr)
-        link->right->left = link->left;
-      if (link->left != nullptr)
-        link->left->right = link->right;
-
-      left = &map->front;
-      right = map->front.right;
-
-      while (right != nullptr && right->distance < link->distance)
-      {
-        left = right;
-        right = right->right;
-      }
-
-      link->right = right;
-      link->left = left;
-      left->right = link;
-      if (right != nullptr)
-        right->left = link;
-    }
+    map->distances[entry] = distance;
+    map->sources.push_back({ distance, entry });
   }
 }
 
+void pdsSetDistance(pdsMap* map, int x, int y, int distance)
+{
+  pdsSetLaneDistance(map, 0, x, y, distance);
+}
+
 void pdsSetCosts(pdsMap* map, int** costMap)
 {
   int i, j;
@@ -173,48 +213,66 @@ void pdsSetCosts(pdsMap* map, int** costMap)
     {
       if (i != 0 && j != 0 && i < DCOLS - 1 && j < DROWS - 1)
       {
-        PDS_CELL(map, i, j)->cost = costMap[i][j];
+        map->costs[PDS_CELL(i, j)] = costMap[i][j];
       }
       else
       {
-        PDS_CELL(map, i, j)->cost = PDS_FORBIDDEN;
+        map->costs[PDS_CELL(i, j)] = PDS_FORBIDDEN;
       }
     }
   }
 }
 
-void pdsBatchInput(pdsMap* map, int** distanceMap, int** costMap, int maxDistance, bool eightWays)
+// Takes each lane's distances from its map, and queues the cells that are passable and have a
+// distance below maxDistance to be scanned from.
+static void pdsInputLanes(pdsMap* map, int** distanceMaps[], int laneCount, int maxDistance)
 {
-  int i, j;
-  pdsLink *left, *right;
+  int lane, i, j, entry;
 
-  map->eightWays = eightWays;
-
-  left = nullptr;
-  right = nullptr;
-
-  map->front.right = nullptr;
-  for (i = 0; i < DCOLS; i++)
+  for (lane = 0; lane < laneCount; lane++)
   {
-    for (j = 0; j < DROWS; j++)
+    for (i = 0; i < DCOLS; i++)
     {
-      pdsLink* link = PDS_CELL(map, i, j);
-
-      if (distanceMap != nullptr)
+      for (j = 0; j < DROWS; j++)
       {
-        link->distance = distanceMap[i][j];
-      }
-      else
-      {
-        if (costMap != nullptr)
+        entry = lane * PDS_CELLS + PDS_CELL(i, j);
+        map->distances[entry] = distanceMaps[lane][i][j];
+        if (map->costs[PDS_CELL(i, j)] > 0 && map->distances[entry] < maxDistance)
         {
-          // totally hackish; refactor
-          link->distance = maxDistance;
+          map->sources.push_back({ map->distances[entry], entry });
         }
       }
+    }
+  }
+}
 
-      int cost;
+static void pdsOutputLanes(pdsMap* map, int** distanceMaps[], int laneCount)
+{
+  int lane, i, j;
+
+  pdsUpdate(map);
+  for (lane = 0; lane < laneCount; lane++)
+  {
+    for (i = 0; i < DCOLS; i++)
+    {
+      for (j = 0; j < DROWS; j++)
+      {
+        distanceMaps[lane][i][j] = map->distances[lane * PDS_CELLS + PDS_CELL(i, j)];
+      }
+    }
+  }
+}
 
+// Takes the costs from costMap, or from the terrain if there isn't one, with the edges of the map
+// obstructed either way.
+static void pdsInputCosts(pdsMap* map, int** costMap)
+{
+  int i, j, cost;
+
+  for (i = 0; i < DCOLS; i++)
+  {
+    for (j = 0; j < DROWS; j++)
+    {
       if (i == 0 || j == 0 || i == DCOLS - 1 || j == DROWS - 1)
       {
         cost = PDS_OBSTRUCTION;
@@ -232,46 +290,37 @@ void pdsBatchInput(pdsMap* map, int** distanceMap, int** costMap, int maxDistanc
         cost = costMap[i][j];
       }
 
-      link->cost = cost;
-
-      if (cost > 0)
-      {
-        if (link->distance < maxDistance)
-        {
-          if (right == nullptr || right->distance > link->distance)
-          {
-            // left and right are used to traverse the list; if many cells have similar values,
-            // some time can be saved by not clearing them with each insertion.  this time,
-            // sadly, we have to start from the front.
+      map->costs[PDS_CELL(i, j)] = cost;
+    }
+  }
+}
 
-            left = &map->front;
-            right = map->front.right;
-          }
+void pdsBatchInput(pdsMap* map, int** distanceMap, int** costMap, int maxDistance, bool eightWays)
+{
+  int i;
 
-          while (right != nullptr && right->distance < link->distance)
-          {
-            left = right;
-            right = right->right;
-          }
+  map->eightWays = eightWays;
 
-          link->right = right;
-          link->left = left;
-          left->right = link;
-          if (right != nullptr)
-            right->left = link;
+  map->sources.clear();
+  pdsSetLaneCount(map, 1);
+  pdsInputCosts(map, costMap);
 
-          left = link;
-        }
-        else
-        {
-          link->right = nullptr;
-          link->left = nullptr;
-        }
+  if (distanceMap != nullptr)
+  {
+    pdsInputLanes(map, &distanceMap, 1, maxDistance);
+  }
+  else
+  {
+    for (i = 0; i < PDS_CELLS; i++)
+    {
+      if (costMap != nullptr)
+      {
+        // totally hackish; refactor
+        map->distances[i] = maxDistance;
       }
-      else
+      if (map->costs[i] > 0 && map->distances[i] < maxDistance)
       {
-        link->right = nullptr;
-        link->left = nullptr;
+        map->sources.push_back({ map->distances[i], i });
       }
     }
   }
@@ -279,17 +328,7 @@ void pdsBatchInput(pdsMap* map, int** distanceMap, int** costMap, int maxDistanc
 
 void pdsBatchOutput(pdsMap* map, int** distanceMap)
 {
-  int i, j;
-
-  pdsUpdate(map);
-  // transfer results to the distanceMap
-  for (i = 0; i < DCOLS; i++)
-  {
-    for (j = 0; j < DROWS; j++)
-    {
-      distanceMap[i][j] = PDS_CELL(map, i, j)->distance;
-    }
-  }
+  pdsOutputLanes(map, &distanceMap, 1);
 }
 
 void pdsInvalidate(pdsMap* map, int maxDistance)
@@ -299,17 +338,170 @@ void pdsInvalidate(pdsMap* map, int maxDistance)
 
 void dijkstraScan(int** distanceMap, int** costMap, bool useDiagonals)
 {
-  static pdsMap map;
+  dijkstraScanBatch(&distanceMap, 1, costMap, useDiagonals);
+}
 
-  pdsBatchInput(&map, distanceMap, costMap, 30000, useDiagonals);
-  pdsBatchOutput(&map, distanceMap);
+// dijkstraScan() for mapCount distance maps over the same costs, all settled in one pass.
+void dijkstraScanBatch(int** distanceMaps[], int mapCount, int** costMap, bool useDiagonals)
+{
+  pdsMap* map = currentGameContext()->scanMap;
+
+  map->eightWays = useDiagonals;
+  map->sources.clear();
+  pdsSetLaneCount(map, mapCount);
+  pdsInputCosts(map, costMap);
+  pdsInputLanes(map, distanceMaps, mapCount, 30000);
+  pdsOutputLanes(map, distanceMaps, mapCount);
+}
+
+// Whether dijkstraScan() scans from a cell, given its cost, its starting distance and the distance it
+// ends up with: it starts from the cells with a cost and a distance below 30000, and goes on from
+// every cell whose distance a neighbor lowered.
+static bool pdsCellSpreads(int cost, int seed, int distance)
+{
+  return cost >= 0 && (distance < seed || (cost > 0 && seed < 30000));
+}
+
+static void pdsMarkForRepair(std::vector<char>& affected, std::vector<int>& repairs, int cell)
+{
+  if (cell >= 0 && cell < PDS_CELLS && !affected[cell])
+  {
+    affected[cell] = true;
+    repairs.push_back(cell);
+  }
+}
+
+// dijkstraScan() for a map that is scanned over and over with only a few cells changing in between,
+// like the safety maps. The pdsMap remembers the costs and starting distances of its last scan along
+// with the distances that came out of it. Only the cells that changed, and the cells whose distances
+// were reached through them, start over; they take what their other neighbors offer and are scanned
+// from again. The distances come out exactly as a full dijkstraScan() would leave them.
+void dijkstraRepairScan(pdsMap* map, int** distanceMap, int** costMap, bool useDiagonals)
+{
+  const int dirs = useDiagonals ? 8 : 4;
+  std::vector<int>& oldCosts = map->oldCosts;
+  std::vector<int>& seeds = map->newSeeds;
+  std::vector<char>& affected = map->affected;
+  std::vector<int>& repairs = map->repairs;
+  int i, j, k, dir, cell, neighbor;
+  int* distances;
+
+  oldCosts.assign(map->costs, map->costs + PDS_CELLS);
+  seeds.resize(PDS_CELLS);
+  affected.assign(PDS_CELLS, false);
+  repairs.clear();
+  pdsInputCosts(map, costMap);
+  for (i = 0; i < DCOLS; i++)
+  {
+    for (j = 0; j < DROWS; j++)
+    {
+      seeds[PDS_CELL(i, j)] = distanceMap[i][j];
+    }
+  }
+  map->sources.clear();
+
+  if (!map->seeds.empty() && map->eightWays == useDiagonals && map->distances.size() == PDS_CELLS)
+  {
+    distances = map->distances.data();
+    for (cell = 0; cell < PDS_CELLS; cell++)
+    {
+      if (map->costs[cell] != oldCosts[cell])
+      {
+        // a cell that starts or stops obstructing also opens or closes the diagonals past it
+        pdsMarkForRepair(affected, repairs, cell);
+        for (dir = 0; dir < 8; dir++)
+        {
+          pdsMarkForRepair(affected, repairs, cell + nbDirs[dir][0] + DCOLS * nbDirs[dir][1]);
+        }
+      }
+      else if (seeds[cell] != map->seeds[cell])
+      {
+        pdsMarkForRepair(affected, repairs, cell);
+      }
+    }
+
+    // Whatever was reached through a changed cell can't keep its distance. Following every neighbor
+    // whose distance is exactly one step on from a repaired cell may take in a few cells that had
+    // another way there too, which costs time but not correctness.
+    for (k = 0; k < (int)repairs.size() && (int)repairs.size() <= PDS_CELLS / 2; k++)
+    {
+      cell = repairs[k];
+      if (!pdsCellSpreads(oldCosts[cell], map->seeds[cell], distances[cell]))
+        continue;
+      for (dir = 0; dir < dirs; dir++)
+      {
+        neighbor = cell + nbDirs[dir][0] + DCOLS * nbDirs[dir][1];
+        if (neighbor >= 0 && neighbor < PDS_CELLS && oldCosts[neighbor] >= 0 &&
+            distances[neighbor] == distances[cell] + oldCosts[neighbor])
+        {
+          pdsMarkForRepair(affected, repairs, neighbor);
+        }
+      }
+    }
+
+    if ((int)repairs.size() <= PDS_CELLS / 2)
+    {
+      for (k = 0; k < (int)repairs.size(); k++)
+      {
+        distances[repairs[k]] = seeds[repairs[k]];
+      }
+      for (k = 0; k < (int)repairs.size(); k++)
+      {
+        cell = repairs[k];
+        if (map->costs[cell] < 0)
+          continue;
+        for (dir = 0; dir < dirs; dir++)
+        {
+          neighbor = cell + nbDirs[dir][0] + DCOLS * nbDirs[dir][1];
+          if (neighbor < 0 || neighbor >= PDS_CELLS || affected[neighbor] ||
+              !pdsCellSpreads(map->costs[neighbor], seeds[neighbor], distances[neighbor]))
+            continue;
+          if (dir >= 4)
+          {
+            const int way1 = cell + nbDirs[dir][0], way2 = cell + DCOLS * nbDirs[dir][1];
+            if ((way1 >= 0 && map->costs[way1] == PDS_OBSTRUCTION) ||
+                (way2 < PDS_CELLS && map->costs[way2] == PDS_OBSTRUCTION))
+              continue;
+          }
+          distances[cell] = min(distances[cell], distances[neighbor] + map->costs[cell]);
+        }
+        if (pdsCellSpreads(map->costs[cell], seeds[cell], distances[cell]))
+        {
+          map->sources.push_back({ distances[cell], cell });
+        }
+      }
+      map->seeds.swap(seeds);
+      pdsOutputLanes(map, &distanceMap, 1);
+      return;
+    }
+  }
+
+  // Nothing to repair from, or so much changed that a fresh scan is cheaper.
+  map->eightWays = useDiagonals;
+  pdsSetLaneCount(map, 1);
+  pdsInputLanes(map, &distanceMap, 1, 30000);
+  map->seeds.swap(seeds);
+  pdsOutputLanes(map, &distanceMap, 1);
 }
 
 void calculateDistances(int** distanceMap, int destinationX, int destinationY, unsigned long blockingTerrainFlags,
                         Creature* traveler, bool canUseSecretDoors, bool eightWays)
 {
+  const int destination[1][2] = { { destinationX, destinationY } };
+
+  calculateDistancesBatch(&distanceMap, destination, 1, blockingTerrainFlags, traveler, canUseSecretDoors, eightWays);
+}
+
+// calculateDistances() to each of mapCount destinations, with the cost map worked out once and all
+// of the maps settled in one pass.
+void calculateDistancesBatch(int** distanceMaps[], const int destinations[][2], int mapCount,
+                             unsigned long blockingTerrainFlags, Creature* traveler, bool canUseSecretDoors,
+                             bool eightWays)
+{
+  const CostMapProfile profile = { TRAVEL_COST_MAP, blockingTerrainFlags, canUseSecretDoors, traveler == &player };
   Creature* monst;
-  static pdsMap map;
+  pdsMap* map = currentGameContext()->distanceMap;
+  int** terrainCosts = cachedCostMap(&profile);
 
   int i, j;
 
@@ -317,7 +509,7 @@ void calculateDistances(int** distanceMap, int destinationX, int destinationY, u
   {
     for (j = 0; j < DROWS; j++)
     {
-      char cost;
+      int cost = terrainCosts[i][j];
       monst = monsterAtLoc(i, j);
       if (monst && (monst->info.flags & (MONST_IMMUNE_TO_WEAPONS | MONST_INVULNERABLE)) &&
           (monst->info.flags & (MONST_IMMOBILE | MONST_GETS_TURN_ON_ACTIVATION)))
@@ -325,40 +517,408 @@ void calculateDistances(int** distanceMap, int destinationX, int destinationY, u
         // Always avoid damage-immune stationary monsters.
         cost = PDS_FORBIDDEN;
       }
-      else if (canUseSecretDoors && cellHasTMFlag(i, j, TM_IS_SECRET) &&
-               cellHasTerrainFlag(i, j, T_OBSTRUCTS_PASSABILITY) &&
-               !(discoveredTerrainFlagsAtLoc(i, j) & T_OBSTRUCTS_PASSABILITY))
+      else if (cost == COST_UNLESS_AVOIDED)
       {
-        cost = 1;
+        cost = (traveler && monsterAvoids(traveler, i, j)) ? PDS_FORBIDDEN : 1;
       }
-      else if (cellHasTerrainFlag(i, j, T_OBSTRUCTS_PASSABILITY) ||
-               (traveler && traveler == &player && !(pmap[i][j].flags & (DISCOVERED | MAGIC_MAPPED))))
+
+      map->costs[PDS_CELL(i, j)] = cost;
+    }
+  }
+
+  map->eightWays = eightWays;
+  map->sources.clear();
+  pdsSetLaneCount(map, mapCount);
+  std::fill(map->distances.begin(), map->distances.end(), 30000);
+  for (i = 0; i < mapCount; i++)
+  {
+    pdsSetLaneDistance(map, i, destinations[i][0], destinations[i][1], 0);
+  }
+  pdsOutputLanes(map, distanceMaps, mapCount);
+}
+
+int pathingDistance(int x1, int y1, int x2, int y2, unsigned long blockingTerrainFlags)
+{
+  Grid<int> distanceMap;
+  calculateDistances(distanceMap, x2, y2, blockingTerrainFlags, nullptr, true, true);
+  return distanceMap[x1][y1];
+}
+
+#pragma mark Benchmark
+
+// The sorted-list scan that the bucket queue replaced, kept so that benchmarkDijkstra() can check the
+// two agree and time one against the other. Only the dijkstraScan() path is reproduced.
+struct ReferenceLink
+{
+  int distance;
+  int cost;
+  ReferenceLink *left, *right;
+};
+
+struct ReferenceMap
+{
+  bool eightWays;
+
+  ReferenceLink front;
+  ReferenceLink links[DCOLS * DROWS];
+};
+
+static void referenceUpdate(ReferenceMap* map)
+{
+  int dir, dirs;
+  ReferenceLink *left = nullptr, *right = nullptr, *link = nullptr;
+
+  dirs = map->eightWays ? 8 : 4;
+
+  ReferenceLink* head = map->front.right;
+  map->front.right = nullptr;
+
+  while (head != nullptr)
+  {
+    for (dir = 0; dir < dirs; dir++)
+    {
+      link = head + (nbDirs[dir][0] + DCOLS * nbDirs[dir][1]);
+      if (link < map->links || link >= map->links + DCOLS * DROWS)
+        continue;
+
+      // verify passability
+      if (link->cost < 0)
+        continue;
+      if (dir >= 4)
       {
-        cost = cellHasTerrainFlag(i, j, T_OBSTRUCTS_DIAGONAL_MOVEMENT) ? PDS_OBSTRUCTION : PDS_FORBIDDEN;
+        ReferenceLink *way1, *way2;
+        way1 = head + nbDirs[dir][0];
+        way2 = head + DCOLS * nbDirs[dir][1];
+        if (way1->cost == PDS_OBSTRUCTION || way2->cost == PDS_OBSTRUCTION)
+          continue;
       }
-      else if ((traveler && monsterAvoids(traveler, i, j)) || cellHasTerrainFlag(i, j, blockingTerrainFlags))
+
+      if (head->distance + link->cost < link->distance)
       {
-        cost = PDS_FORBIDDEN;
+        link->distance = head->distance + link->cost;
+
+        if (link->right != nullptr)
+          link->right->left = link->left;
+        if (link->left != nullptr)
+          link->left->right = link->right;
+
+        left = head;
+        right = head->right;
+        while (right != nullptr && right->distance < link->distance)
+        {
+          left = right;
+          right = right->right;
+        }
+        if (left != nullptr)
+          left->right = link;
+        link->right = right;
+        link->left = left;
+        if (right != nullptr)
+          right->left = link;
+      }
+    }
+
+    right = head->right;
+
+    head->left = nullptr;
+    head->right = nullptr;
+
+    head = right;
+  }
+}
+
+static void referenceScan(ReferenceMap* map, int** distanceMap, int** costMap, bool useDiagonals)
+{
+  int i, j;
+  ReferenceLink *left = nullptr, *right = nullptr;
+
+  map->eightWays = useDiagonals;
+  map->front.right = nullptr;
+  for (i = 0; i < DCOLS; i++)
+  {
+    for (j = 0; j < DROWS; j++)
+    {
+      ReferenceLink* link = &map->links[i + DCOLS * j];
+
+      link->distance = distanceMap[i][j];
+      link->cost = (i == 0 || j == 0 || i == DCOLS - 1 || j == DROWS - 1) ? PDS_OBSTRUCTION : costMap[i][j];
+      link->left = link->right = nullptr;
+      if (link->cost > 0 && link->distance < 30000)
+      {
+        if (right == nullptr || right->distance > link->distance)
+        {
+          left = &map->front;
+          right = map->front.right;
+        }
+        while (right != nullptr && right->distance < link->distance)
+        {
+          left = right;
+          right = right->right;
+        }
+        link->right = right;
+        link->left = left;
+        left->right = link;
+        if (right != nullptr)
+          right->left = link;
+        left = link;
+      }
+    }
+  }
+
+  referenceUpdate(map);
+  for (i = 0; i < DCOLS; i++)
+  {
+    for (j = 0; j < DROWS; j++)
+    {
+      distanceMap[i][j] = map->links[i + DCOLS * j].distance;
+    }
+  }
+}
+
+struct DijkstraTimings
+{
+  double bucketSeconds;
+  double referenceSeconds;
+  long calls;
+  long mismatches;
+};
+
+// Scans distanceMap both ways, times each and counts a mismatch if the results differ. Leaves the
+// bucket queue's result in distanceMap.
+static void timeScan(DijkstraTimings* timings, ReferenceMap* reference, int** distanceMap, int** costMap,
+                     bool useDiagonals)
+{
+  Grid<int> referenceMap;
+  std::chrono::steady_clock::time_point start;
+
+  copyGrid(referenceMap, distanceMap);
+
+  start = std::chrono::steady_clock::now();
+  dijkstraScan(distanceMap, costMap, useDiagonals);
+  timings->bucketSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  start = std::chrono::steady_clock::now();
+  referenceScan(reference, referenceMap, costMap, useDiagonals);
+  timings->referenceSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  timings->calls++;
+  if (memcmp(referenceMap.cells, distanceMap[0], sizeof(referenceMap.cells)))
+  {
+    timings->mismatches++;
+  }
+}
+
+// The scans the game leans on hardest, on the current level: the distance to one cell (as
+// calculateDistances() and the travel maps do), then a flight map seeded with the negated, squashed
+// result, as updateSafetyMap() does, whose many equal-distance seeds are the sorted list's worst case.
+static void benchmarkLevel(DijkstraTimings* single, DijkstraTimings* flight, ReferenceMap* reference)
+{
+  Grid<int> costMap, distanceMap;
+  int i, j, trial, x, y;
+
+  for (i = 0; i < DCOLS; i++)
+  {
+    for (j = 0; j < DROWS; j++)
+    {
+      if (cellHasTerrainFlag(i, j, T_OBSTRUCTS_PASSABILITY))
+      {
+        costMap[i][j] = cellHasTerrainFlag(i, j, T_OBSTRUCTS_DIAGONAL_MOVEMENT) ? PDS_OBSTRUCTION : PDS_FORBIDDEN;
+      }
+      else if (cellHasTerrainFlag(i, j, T_PATHING_BLOCKER & ~T_OBSTRUCTS_PASSABILITY))
+      {
+        costMap[i][j] = PDS_FORBIDDEN;
       }
       else
       {
-        cost = 1;
+        costMap[i][j] = cellHasTerrainFlag(i, j, T_HARMFUL_TERRAIN) ? 5 : 1;
       }
+    }
+  }
+
+  for (trial = 0; trial < 20; trial++)
+  {
+    do
+    {
+      x = rand_range(1, DCOLS - 2);
+      y = rand_range(1, DROWS - 2);
+    } while (costMap[x][y] <= 0);
+
+    distanceMap.fill(30000);
+    distanceMap[x][y] = 0;
+    timeScan(single, reference, distanceMap, costMap, true);
 
-      PDS_CELL(&map, i, j)->cost = cost;
+    for (i = 0; i < DCOLS; i++)
+    {
+      for (j = 0; j < DROWS; j++)
+      {
+        if (distanceMap[i][j] == 30000)
+        {
+          distanceMap[i][j] = 150;
+        }
+        distanceMap[i][j] = -3 * (50 * distanceMap[i][j] / (50 + distanceMap[i][j]));
+      }
     }
+    timeScan(flight, reference, distanceMap, costMap, false);
   }
+}
 
-  pdsClear(&map, 30000, eightWays);
-  pdsSetDistance(&map, destinationX, destinationY, 0);
-  pdsBatchOutput(&map, distanceMap);
+static void reportTimings(FILE* report, const char* name, const DijkstraTimings* timings)
+{
+  fprintf(report, "%-12s %7li calls  bucket queue %8.2f us/call  sorted list %8.2f us/call  %5.2fx  %li mismatched\n",
+          name, timings->calls, 1e6 * timings->bucketSeconds / max(1, timings->calls),
+          1e6 * timings->referenceSeconds / max(1, timings->calls),
+          timings->referenceSeconds / max(1e-9, timings->bucketSeconds), timings->mismatches);
 }
 
-int pathingDistance(int x1, int y1, int x2, int y2, unsigned long blockingTerrainFlags)
+// Generates the first depth levels of count seeds from firstSeed, times dijkstraScan() against the
+// old sorted-list scan on each, and writes per-call latencies to report. Returns the number of scans
+// whose output differed, which should always be zero.
+long benchmarkDijkstra(unsigned long firstSeed, int seedCount, int depth, FILE* report)
 {
-  int retval, **distanceMap = allocGrid();
-  calculateDistances(distanceMap, x2, y2, blockingTerrainFlags, nullptr, true, true);
-  retval = distanceMap[x1][y1];
-  freeGrid(distanceMap);
-  return retval;
+  DijkstraTimings single = { 0, 0, 0, 0 }, flight = { 0, 0, 0, 0 };
+  ReferenceMap* reference = new ReferenceMap;
+  char path[BROGUE_FILENAME_MAX];
+  unsigned long theSeed;
+
+  getAvailableFilePath(path, LAST_GAME_NAME, GAME_SUFFIX);
+  strcat(path, GAME_SUFFIX);
+
+  for (theSeed = firstSeed; theSeed < firstSeed + seedCount; theSeed++)
+  {
+    rogue.nextGamePath[0] = '\0';
+    rogue.playbackMode = false;
+    rogue.playbackBetweenTurns = false;
+    strcpy(currentFilePath, path);
+    initializeRogue(theSeed);
+    for (rogue.depthLevel = 1; rogue.depthLevel <= depth; rogue.depthLevel++)
+    {
+      startLevel(rogue.depthLevel == 1 ? 1 : rogue.depthLevel - 1, 1);
+      benchmarkLevel(&single, &flight, reference);
+    }
+    freeEverything();
+    remove(currentFilePath);
+  }
+  delete reference;
+
+  fprintf(report, "# %i seeds, depths 1 to %i\n", seedCount, depth);
+  reportTimings(report, "to one cell", &single);
+  reportTimings(report, "flight map", &flight);
+  return single.mismatches + flight.mismatches;
+}
+
+// A random cost for a cell of benchmarkDijkstraRepair()'s maps: mostly plain floor, with the zero costs,
+// forbidden cells and obstructions that a repair has to get right.
+static int randomRepairCost()
+{
+  const int roll = rand_range(0, 99);
+
+  if (roll < 60)
+  {
+    return 1;
+  }
+  else if (roll < 70)
+  {
+    return 0;
+  }
+  else if (roll < 80)
+  {
+    return rand_range(2, 10);
+  }
+  else if (roll < 90)
+  {
+    return PDS_FORBIDDEN;
+  }
+  else
+  {
+    return PDS_OBSTRUCTION;
+  }
+}
+
+// A random starting distance: mostly unreached, with a few seeds, some of them negative like a flight map's.
+static int randomRepairSeed()
+{
+  const int roll = rand_range(0, 99);
+
+  if (roll < 96)
+  {
+    return 30000;
+  }
+  else if (roll < 98)
+  {
+    return rand_range(0, 50);
+  }
+  else
+  {
+    return -rand_range(1, 150);
+  }
+}
+
+// Runs count sequences of random maps from seed, each scanned twenty times with a few random costs or
+// starting distances changed before every scan, through dijkstraRepairScan() and through a full
+// dijkstraScan(). Writes per-call latencies to report and returns the number of scans where the two
+// differed, which should always be zero.
+long benchmarkDijkstraRepair(unsigned long seed, int count, FILE* report)
+{
+  DijkstraTimings timings = { 0, 0, 0, 0 };  // the repair in place of the bucket queue, the full scan as reference
+  Grid<int> costMap, seedMap, repairedMap, scannedMap;
+  std::chrono::steady_clock::time_point start;
+  pdsMap* map;
+  int sequence, scan, change, i, j;
+  bool useDiagonals;
+
+  seedRandomGenerator(seed);
+  for (sequence = 0; sequence < count; sequence++)
+  {
+    map = allocPdsMap();
+    useDiagonals = rand_percent(50);
+    for (i = 0; i < DCOLS; i++)
+    {
+      for (j = 0; j < DROWS; j++)
+      {
+        costMap[i][j] = randomRepairCost();
+        seedMap[i][j] = randomRepairSeed();
+      }
+    }
+
+    for (scan = 0; scan < 20; scan++)
+    {
+      for (change = (scan ? rand_range(1, 6) : 0); change > 0; change--)
+      {
+        i = rand_range(1, DCOLS - 2);
+        j = rand_range(1, DROWS - 2);
+        if (rand_percent(70))
+        {
+          costMap[i][j] = randomRepairCost();
+        }
+        else
+        {
+          seedMap[i][j] = randomRepairSeed();
+        }
+      }
+      repairedMap = seedMap;
+      scannedMap = seedMap;
+
+      start = std::chrono::steady_clock::now();
+      dijkstraRepairScan(map, repairedMap, costMap, useDiagonals);
+      timings.bucketSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+      start = std::chrono::steady_clock::now();
+      dijkstraScan(scannedMap, costMap, useDiagonals);
+      timings.referenceSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+      timings.calls++;
+      if (memcmp(repairedMap.cells, scannedMap.cells, sizeof(repairedMap.cells)))
+      {
+        timings.mismatches++;
+      }
+    }
+    freePdsMap(map);
+  }
+
+  fprintf(report, "# %i sequences of random edits from seed %lu\n", count, seed);
+  fprintf(report, "%-12s %7li calls  repair %8.2f us/call  full scan %8.2f us/call  %5.2fx  %li mismatched\n",
+          "repair scan", timings.calls, 1e6 * timings.bucketSeconds / max(1, timings.calls),
+          1e6 * timings.referenceSeconds / max(1, timings.calls),
+          timings.referenceSeconds / max(1e-9, timings.bucketSeconds), timings.mismatches);
+  return timings.mismatches;
 }
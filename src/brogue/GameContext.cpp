@@ -0,0 +1,83 @@
+/*
+ *  GameContext.cpp
+ *  Brogue++
+ *
+ *  Written by Jason I Mercer
+ *
+ *  Based on code and ideas by Brian Walker
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <thread>
+#include <vector>
+
+#include "IncludeGlobals.h"
+#include "Rogue.h"
+#include "Grid.h"
+
+namespace
+{
+// Owns a thread's context and releases its scratch maps when the thread exits.
+struct ThreadGameContext
+{
+  GameContext context;
+
+  ThreadGameContext()
+  {
+    context.scanMap = allocPdsMap();
+    context.distanceMap = allocPdsMap();
+    for (pdsMap*& scan : context.rememberedScans)
+    {
+      scan = allocPdsMap();
+    }
+  }
+
+  ~ThreadGameContext()
+  {
+    freePdsMap(context.scanMap);
+    freePdsMap(context.distanceMap);
+    for (pdsMap* scan : context.rememberedScans)
+    {
+      freePdsMap(scan);
+    }
+    for (Grid<int>* grid : context.spareGrids)
+    {
+      delete grid;
+    }
+  }
+};
+}  // namespace
+
+GameContext* currentGameContext()
+{
+  static thread_local ThreadGameContext threadContext;
+  return &threadContext.context;
+}
+
+void runGamesInParallel(int gameCount, void (*body)(int gameIndex, void* data), void* data)
+{
+  std::vector<std::thread> threads;
+  int i;
+
+  threads.reserve(gameCount);
+  for (i = 0; i < gameCount; i++)
+  {
+    threads.emplace_back(body, i, data);
+  }
+  for (std::thread& thread : threads)
+  {
+    thread.join();
+  }
+}
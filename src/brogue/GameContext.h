@@ -0,0 +1,65 @@
+/*
+ *  GameContext.h
+ *  Brogue++
+ *
+ *  Written by Jason I Mercer
+ *
+ *  Based on code and ideas by Brian Walker
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GAMECONTEXT_H
+#define GAMECONTEXT_H
+
+#include <vector>
+
+template <typename T>
+struct Grid;
+
+// The scans that updateSafetyMap() and updateAllySafetyMap() repair from one turn to the next.
+enum rememberedScanIndices
+{
+  SAFETY_DISTANCE_SCAN,
+  SAFETY_FLIGHT_SCAN,
+  ALLY_SAFETY_DISTANCE_SCAN,
+  ALLY_SAFETY_FLIGHT_SCAN,
+  NUMBER_REMEMBERED_SCANS
+};
+
+// One running game. The engine reaches its game state through globals (pmap, levels, rogue, player,
+// the creature and item chains, safetyMap and friends), and those are declared thread_local in
+// IncludeGlobals.h, so every thread simulates its own independent dungeon. The context owns the
+// per-game state that isn't one of those globals, such as the Dijkstra scratch maps and the grid pool.
+//
+// The display state is per thread too: displayBuffer, displayDetail, the message lines and archive,
+// and the dynamic colors that updateColors() sets for each depth (with tileCatalog and lightCatalog,
+// which point at them). The platform console is not, so a game running beside another must keep
+// rogue.playbackFastForward set, which stops it from drawing.
+struct GameContext
+{
+  struct pdsMap* scanMap;              // scratch for dijkstraScan()
+  struct pdsMap* distanceMap;          // scratch for calculateDistances()
+  struct pdsMap* rememberedScans[NUMBER_REMEMBERED_SCANS];  // for dijkstraRepairScan()
+  std::vector<Grid<int>*> spareGrids;  // freed by freeGrid(), for allocGrid() to hand out again
+};
+
+// The calling thread's context, created the first time it is asked for.
+GameContext* currentGameContext();
+
+// Calls body(gameIndex, data) for every gameIndex in [0, gameCount), each on its own thread and so in
+// its own game, and returns once all of them have finished.
+void runGamesInParallel(int gameCount, void (*body)(int gameIndex, void* data), void* data);
+
+#endif  // GAMECONTEXT_H
@@ -0,0 +1,244 @@
+/*
+ *  Grid.h
+ *  Brogue++
+ *
+ *  Written by Jason I Mercer
+ *
+ *  Based on code and ideas by Brian Walker
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRID_H
+#define GRID_H
+
+#include "Rogue.h"
+
+constexpr int GRID_CELLS = DCOLS * DROWS;
+constexpr size_t MAX_SPARE_GRIDS = 64;  // freed grids that each game keeps for allocGrid() to reuse
+
+// The whole-grid operations, over the cells of a grid laid out contiguously. Every grid is: both
+// Grid<T> and the int** grids handed out by allocGrid(), whose cells all follow grid[0].
+template <typename T>
+void fillCells(T* cells, T value)
+{
+  for (int i = 0; i < GRID_CELLS; i++)
+  {
+    cells[i] = value;
+  }
+}
+
+template <typename T>
+void copyCells(T* to, const T* from)
+{
+  for (int i = 0; i < GRID_CELLS; i++)
+  {
+    to[i] = from[i];
+  }
+}
+
+template <typename T>
+void findReplaceCells(T* cells, T findValueMin, T findValueMax, T fillValue)
+{
+  for (int i = 0; i < GRID_CELLS; i++)
+  {
+    if (cells[i] >= findValueMin && cells[i] <= findValueMax)
+    {
+      cells[i] = fillValue;
+    }
+  }
+}
+
+template <typename T>
+void intersectCells(T* onto, const T* from)
+{
+  for (int i = 0; i < GRID_CELLS; i++)
+  {
+    onto[i] = (onto[i] && from[i]);
+  }
+}
+
+template <typename T>
+void uniteCells(T* onto, const T* from)
+{
+  for (int i = 0; i < GRID_CELLS; i++)
+  {
+    onto[i] = (onto[i] ? onto[i] : from[i]);
+  }
+}
+
+template <typename T>
+void invertCells(T* cells)
+{
+  for (int i = 0; i < GRID_CELLS; i++)
+  {
+    cells[i] = !cells[i];
+  }
+}
+
+template <typename T>
+int countCells(const T* cells, T value)
+{
+  int count = 0;
+  for (int i = 0; i < GRID_CELLS; i++)
+  {
+    count += (cells[i] == value);
+  }
+  return count;
+}
+
+template <typename T>
+T leastPositiveCell(const T* cells)
+{
+  T leastPositiveValue = 0;
+  for (int i = 0; i < GRID_CELLS; i++)
+  {
+    if (cells[i] > 0 && (leastPositiveValue == 0 || cells[i] < leastPositiveValue))
+    {
+      leastPositiveValue = cells[i];
+    }
+  }
+  return leastPositiveValue;
+}
+
+// The same operations on int grids, in whichever version suits the CPU: AVX2, SSE2 or the scalar
+// templates above. The vector versions give exactly the scalar results, so recordings don't care which
+// one a machine picks. Chosen on first use; see GridKernels.cpp.
+struct GridKernels
+{
+  void (*fill)(int* cells, int value);
+  void (*copy)(int* to, const int* from);
+  void (*findReplace)(int* cells, int findValueMin, int findValueMax, int fillValue);
+  void (*intersect)(int* onto, const int* from);
+  void (*unite)(int* onto, const int* from);
+  void (*invert)(int* cells);
+  int (*count)(const int* cells, int value);
+  int (*leastPositive)(const int* cells);
+  const char* name;
+};
+
+const GridKernels& gridKernels();
+
+// A set of cells, a bit per cell, laid out like the terrain flag planes: column x is columns[x], with
+// bit y for row y. A column fits in one word, so floodCellSet() moves a whole column at a time rather
+// than recursing from cell to cell.
+struct CellSet
+{
+  unsigned long columns[DCOLS];
+
+  void clear()
+  {
+    for (int i = 0; i < DCOLS; i++)
+    {
+      columns[i] = 0;
+    }
+  }
+
+  void add(int x, int y)
+  {
+    columns[x] |= 1UL << y;
+  }
+
+  bool contains(int x, int y) const
+  {
+    return (columns[x] >> y) & 1;
+  }
+
+  int count() const
+  {
+    int count = 0;
+    for (int i = 0; i < DCOLS; i++)
+    {
+      for (unsigned long column = columns[i]; column; column &= column - 1)
+      {
+        count++;
+      }
+    }
+    return count;
+  }
+};
+
+// The lowest row set in a nonzero CellSet column.
+inline int lowestRow(unsigned long column)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzl(column);
+#else
+  int row = 0;
+
+  while (!(column & 1))
+  {
+    column >>= 1;
+    row++;
+  }
+  return row;
+#endif
+}
+
+// Grows region to every cell of passable that it can reach in the four cardinal directions. The cells
+// already in region spread whether or not they're passable themselves. With spreaders, a cell spreads
+// in direction dir (the first four of nbDirs: up, down, left, right) only if it's in spreaders[dir].
+void floodCellSet(CellSet* region, const CellSet* passable, const CellSet* spreaders = nullptr);
+
+// A DCOLS x DROWS grid held by value, so that a scratch grid can live on the stack instead of being
+// malloced and freed every time it's needed. Cells are column-major like pmap: (x, y) is
+// cells[x * DROWS + y], so grid[x][y] works as it always has. A Grid converts to int** (or T**) for
+// everything that still takes one.
+template <typename T>
+struct Grid
+{
+  T cells[GRID_CELLS];
+  T* columns[DCOLS];
+
+  Grid()
+  {
+    for (int i = 0; i < DCOLS; i++)
+    {
+      columns[i] = &cells[i * DROWS];
+    }
+  }
+
+  Grid(const Grid& other) : Grid()
+  {
+    copyCells(cells, other.cells);
+  }
+
+  Grid& operator=(const Grid& other)
+  {
+    copyCells(cells, other.cells);
+    return *this;
+  }
+
+  T* operator[](int x)
+  {
+    return &cells[x * DROWS];
+  }
+
+  const T* operator[](int x) const
+  {
+    return &cells[x * DROWS];
+  }
+
+  operator T**()
+  {
+    return columns;
+  }
+
+  void fill(T value)
+  {
+    fillCells(cells, value);
+  }
+};
+
+#endif  // GRID_H
@@ -0,0 +1,441 @@
+/*
+ *  GridKernels.cpp
+ *  Brogue++
+ *
+ *  Written by Jason I Mercer
+ *
+ *  Based on code and ideas by Brian Walker
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include <chrono>
+#include <vector>
+
+// Before Rogue.h, whose min and max macros would otherwise reach into the intrinsics headers.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define GRID_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+#include "Rogue.h"
+#include "Grid.h"
+
+// The scalar kernels are the reference: the vector ones have to match them exactly, and they do
+// the leftover cells at the end of a grid that don't fill a whole vector.
+
+static void scalarFill(int* cells, int value)
+{
+  fillCells(cells, value);
+}
+
+static void scalarCopy(int* to, const int* from)
+{
+  copyCells(to, from);
+}
+
+static void scalarFindReplace(int* cells, int findValueMin, int findValueMax, int fillValue)
+{
+  findReplaceCells(cells, findValueMin, findValueMax, fillValue);
+}
+
+static void scalarIntersect(int* onto, const int* from)
+{
+  intersectCells(onto, from);
+}
+
+static void scalarUnite(int* onto, const int* from)
+{
+  uniteCells(onto, from);
+}
+
+static void scalarInvert(int* cells)
+{
+  invertCells(cells);
+}
+
+static int scalarCount(const int* cells, int value)
+{
+  return countCells(cells, value);
+}
+
+static int scalarLeastPositive(const int* cells)
+{
+  return leastPositiveCell(cells);
+}
+
+static const GridKernels scalarKernels = { scalarFill,   scalarCopy,  scalarFindReplace,   scalarIntersect,
+                                           scalarUnite,  scalarInvert, scalarCount, scalarLeastPositive,
+                                           "scalar" };
+
+#ifdef GRID_KERNELS_X86
+
+// One set of kernels per instruction set, written once against these few operations. VEC is the
+// vector type, LANES how many ints it holds.
+#define GRID_KERNEL_SET(PREFIX, TARGET, VEC, LANES, LOAD, STORE, SET1, ZERO, AND, ANDNOT, OR, CMPEQ, CMPGT, SUB,  \
+                        LANE_TOTAL, LANE_MIN)                                                                      \
+  __attribute__((target(TARGET))) static void PREFIX##Fill(int* cells, int value)                                  \
+  {                                                                                                                \
+    const VEC v = SET1(value);                                                                                     \
+    int i;                                                                                                         \
+    for (i = 0; i + LANES <= GRID_CELLS; i += LANES)                                                               \
+    {                                                                                                              \
+      STORE((VEC*)&cells[i], v);                                                                                   \
+    }                                                                                                              \
+    for (; i < GRID_CELLS; i++)                                                                                    \
+    {                                                                                                              \
+      cells[i] = value;                                                                                            \
+    }                                                                                                              \
+  }                                                                                                                \
+                                                                                                                   \
+  __attribute__((target(TARGET))) static void PREFIX##Copy(int* to, const int* from)                               \
+  {                                                                                                                \
+    int i;                                                                                                         \
+    for (i = 0; i + LANES <= GRID_CELLS; i += LANES)                                                               \
+    {                                                                                                              \
+      STORE((VEC*)&to[i], LOAD((const VEC*)&from[i]));                                                             \
+    }                                                                                                              \
+    for (; i < GRID_CELLS; i++)                                                                                    \
+    {                                                                                                              \
+      to[i] = from[i];                                                                                             \
+    }                                                                                                              \
+  }                                                                                                                \
+                                                                                                                   \
+  __attribute__((target(TARGET))) static void PREFIX##FindReplace(int* cells, int findValueMin, int findValueMax,  \
+                                                                  int fillValue)                                   \
+  {                                                                                                                \
+    const VEC low = SET1(findValueMin), high = SET1(findValueMax), fill = SET1(fillValue);                         \
+    int i;                                                                                                         \
+    for (i = 0; i + LANES <= GRID_CELLS; i += LANES)                                                               \
+    {                                                                                                              \
+      const VEC v = LOAD((const VEC*)&cells[i]);                                                                   \
+      const VEC outside = OR(CMPGT(low, v), CMPGT(v, high));                                                       \
+      STORE((VEC*)&cells[i], OR(AND(outside, v), ANDNOT(outside, fill)));                                          \
+    }                                                                                                              \
+    for (; i < GRID_CELLS; i++)                                                                                    \
+    {                                                                                                              \
+      if (cells[i] >= findValueMin && cells[i] <= findValueMax)                                                    \
+      {                                                                                                            \
+        cells[i] = fillValue;                                                                                      \
+      }                                                                                                            \
+    }                                                                                                              \
+  }                                                                                                                \
+                                                                                                                   \
+  __attribute__((target(TARGET))) static void PREFIX##Intersect(int* onto, const int* from)                        \
+  {                                                                                                                \
+    const VEC zero = ZERO(), one = SET1(1);                                                                        \
+    int i;                                                                                                         \
+    for (i = 0; i + LANES <= GRID_CELLS; i += LANES)                                                               \
+    {                                                                                                              \
+      const VEC eitherEmpty =                                                                                      \
+          OR(CMPEQ(LOAD((const VEC*)&onto[i]), zero), CMPEQ(LOAD((const VEC*)&from[i]), zero));                   \
+      STORE((VEC*)&onto[i], ANDNOT(eitherEmpty, one));                                                             \
+    }                                                                                                              \
+    for (; i < GRID_CELLS; i++)                                                                                    \
+    {                                                                                                              \
+      onto[i] = (onto[i] && from[i]);                                                                              \
+    }                                                                                                              \
+  }                                                                                                                \
+                                                                                                                   \
+  __attribute__((target(TARGET))) static void PREFIX##Unite(int* onto, const int* from)                            \
+  {                                                                                                                \
+    const VEC zero = ZERO();                                                                                       \
+    int i;                                                                                                         \
+    for (i = 0; i + LANES <= GRID_CELLS; i += LANES)                                                               \
+    {                                                                                                              \
+      const VEC v = LOAD((const VEC*)&onto[i]);                                                                    \
+      const VEC empty = CMPEQ(v, zero);                                                                            \
+      STORE((VEC*)&onto[i], OR(AND(empty, LOAD((const VEC*)&from[i])), v));                                        \
+    }                                                                                                              \
+    for (; i < GRID_CELLS; i++)                                                                                    \
+    {                                                                                                              \
+      onto[i] = (onto[i] ? onto[i] : from[i]);                                                                     \
+    }                                                                                                              \
+  }                                                                                                                \
+                                                                                                                   \
+  __attribute__((target(TARGET))) static void PREFIX##Invert(int* cells)                                           \
+  {                                                                                                                \
+    const VEC zero = ZERO(), one = SET1(1);                                                                        \
+    int i;                                                                                                         \
+    for (i = 0; i + LANES <= GRID_CELLS; i += LANES)                                                               \
+    {                                                                                                              \
+      STORE((VEC*)&cells[i], AND(CMPEQ(LOAD((const VEC*)&cells[i]), zero), one));                                  \
+    }                                                                                                              \
+    for (; i < GRID_CELLS; i++)                                                                                    \
+    {                                                                                                              \
+      cells[i] = !cells[i];                                                                                        \
+    }                                                                                                              \
+  }                                                                                                                \
+                                                                                                                   \
+  __attribute__((target(TARGET))) static int PREFIX##Count(const int* cells, int value)                            \
+  {                                                                                                                \
+    const VEC v = SET1(value);                                                                                     \
+    VEC matches = ZERO();                                                                                          \
+    int i, count;                                                                                                  \
+    for (i = 0; i + LANES <= GRID_CELLS; i += LANES)                                                               \
+    {                                                                                                              \
+      matches = SUB(matches, CMPEQ(LOAD((const VEC*)&cells[i]), v)); /* a match is -1 */                           \
+    }                                                                                                              \
+    count = LANE_TOTAL(matches);                                                                                   \
+    for (; i < GRID_CELLS; i++)                                                                                    \
+    {                                                                                                              \
+      count += (cells[i] == value);                                                                                \
+    }                                                                                                              \
+    return count;                                                                                                  \
+  }                                                                                                                \
+                                                                                                                   \
+  __attribute__((target(TARGET))) static int PREFIX##LeastPositive(const int* cells)                               \
+  {                                                                                                                \
+    /* Non-positive cells count as INT_MAX; anyPositive tells an INT_MAX cell from an empty grid. */               \
+    const VEC zero = ZERO(), ceiling = SET1(INT_MAX);                                                              \
+    VEC least = ceiling, anyPositive = ZERO();                                                                     \
+    int i, leastPositiveValue;                                                                                     \
+    for (i = 0; i + LANES <= GRID_CELLS; i += LANES)                                                               \
+    {                                                                                                              \
+      const VEC v = LOAD((const VEC*)&cells[i]);                                                                   \
+      const VEC positive = CMPGT(v, zero);                                                                         \
+      const VEC candidate = OR(AND(positive, v), ANDNOT(positive, ceiling));                                       \
+      const VEC smaller = CMPGT(least, candidate);                                                                 \
+      least = OR(AND(smaller, candidate), ANDNOT(smaller, least));                                                 \
+      anyPositive = OR(anyPositive, positive);                                                                     \
+    }                                                                                                              \
+    leastPositiveValue = LANE_MIN(least);                                                                          \
+    if (leastPositiveValue == INT_MAX && !LANE_TOTAL(anyPositive))                                                 \
+    {                                                                                                              \
+      leastPositiveValue = 0;                                                                                      \
+    }                                                                                                              \
+    for (; i < GRID_CELLS; i++)                                                                                    \
+    {                                                                                                              \
+      if (cells[i] > 0 && (leastPositiveValue == 0 || cells[i] < leastPositiveValue))                              \
+      {                                                                                                            \
+        leastPositiveValue = cells[i];                                                                             \
+      }                                                                                                            \
+    }                                                                                                              \
+    return leastPositiveValue;                                                                                     \
+  }                                                                                                                \
+                                                                                                                   \
+  static const GridKernels PREFIX##Kernels = { PREFIX##Fill,      PREFIX##Copy,   PREFIX##FindReplace,             \
+                                               PREFIX##Intersect, PREFIX##Unite,  PREFIX##Invert,                  \
+                                               PREFIX##Count,     PREFIX##LeastPositive, TARGET };
+
+// Horizontal sums and minimums, done through memory; they run once per kernel call.
+__attribute__((target("sse2"))) static int sse2Total(__m128i v)
+{
+  int lanes[4], total = 0;
+  _mm_storeu_si128((__m128i*)lanes, v);
+  for (int lane : lanes)
+  {
+    total += lane;
+  }
+  return total;
+}
+
+__attribute__((target("sse2"))) static int sse2Min(__m128i v)
+{
+  int lanes[4], least = INT_MAX;
+  _mm_storeu_si128((__m128i*)lanes, v);
+  for (int lane : lanes)
+  {
+    least = min(least, lane);
+  }
+  return least;
+}
+
+__attribute__((target("avx2"))) static int avx2Total(__m256i v)
+{
+  int lanes[8], total = 0;
+  _mm256_storeu_si256((__m256i*)lanes, v);
+  for (int lane : lanes)
+  {
+    total += lane;
+  }
+  return total;
+}
+
+__attribute__((target("avx2"))) static int avx2Min(__m256i v)
+{
+  int lanes[8], least = INT_MAX;
+  _mm256_storeu_si256((__m256i*)lanes, v);
+  for (int lane : lanes)
+  {
+    least = min(least, lane);
+  }
+  return least;
+}
+
+GRID_KERNEL_SET(sse2, "sse2", __m128i, 4, _mm_loadu_si128, _mm_storeu_si128, _mm_set1_epi32, _mm_setzero_si128,
+                _mm_and_si128, _mm_andnot_si128, _mm_or_si128, _mm_cmpeq_epi32, _mm_cmpgt_epi32, _mm_sub_epi32,
+                sse2Total, sse2Min)
+
+GRID_KERNEL_SET(avx2, "avx2", __m256i, 8, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_set1_epi32,
+                _mm256_setzero_si256, _mm256_and_si256, _mm256_andnot_si256, _mm256_or_si256, _mm256_cmpeq_epi32,
+                _mm256_cmpgt_epi32, _mm256_sub_epi32, avx2Total, avx2Min)
+
+#endif  // GRID_KERNELS_X86
+
+static const GridKernels* chooseGridKernels()
+{
+#ifdef GRID_KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+  {
+    return &avx2Kernels;
+  }
+  if (__builtin_cpu_supports("sse2"))
+  {
+    return &sse2Kernels;
+  }
+#endif
+  return &scalarKernels;
+}
+
+const GridKernels& gridKernels()
+{
+  static const GridKernels* kernels = chooseGridKernels();
+  return *kernels;
+}
+
+enum gridKernelOps
+{
+  KERNEL_FILL,
+  KERNEL_COPY,
+  KERNEL_FIND_REPLACE,
+  KERNEL_INTERSECT,
+  KERNEL_UNITE,
+  KERNEL_INVERT,
+  KERNEL_COUNT,
+  KERNEL_LEAST_POSITIVE,
+  NUMBER_KERNEL_OPS
+};
+
+// Calls one kernel of a table on grid, with other as the second grid of the ones that take two, and
+// returns what it returns, or zero.
+static int runGridKernel(const GridKernels* kernels, int op, int* grid, const int* other)
+{
+  switch (op)
+  {
+    case KERNEL_FILL:
+      kernels->fill(grid, 7);
+      return 0;
+    case KERNEL_COPY:
+      kernels->copy(grid, other);
+      return 0;
+    case KERNEL_FIND_REPLACE:
+      kernels->findReplace(grid, -1, 1, 2);
+      return 0;
+    case KERNEL_INTERSECT:
+      kernels->intersect(grid, other);
+      return 0;
+    case KERNEL_UNITE:
+      kernels->unite(grid, other);
+      return 0;
+    case KERNEL_INVERT:
+      kernels->invert(grid);
+      return 0;
+    case KERNEL_COUNT:
+      return kernels->count(grid, 2);
+    case KERNEL_LEAST_POSITIVE:
+      return kernels->leastPositive(grid);
+  }
+  return 0;
+}
+
+// Mostly the small values the game's grids hold, with the odd INT_MAX or INT_MIN.
+static int randomKernelValue(unsigned long long* state)
+{
+  int roll;
+
+  *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+  roll = (int)((*state >> 33) % 100);
+  return roll == 0 ? INT_MAX : roll == 1 ? INT_MIN : roll % 9 - 3;
+}
+
+// Checks every kernel of each table this CPU can run against the scalar table on a thousand random
+// grids, then times rounds calls of each kernel in each table and writes the per-call latencies to
+// report. Returns the number of calls whose results differed from the scalar ones, which should
+// always be zero.
+long benchmarkGridKernels(long rounds, FILE* report)
+{
+  const char opNames[NUMBER_KERNEL_OPS][16] = { "fill",  "copy",   "find/replace", "intersect",
+                                                "unite", "invert", "count",        "least positive" };
+  std::vector<const GridKernels*> tables = { &scalarKernels };
+  std::vector<int> source(GRID_CELLS), other(GRID_CELLS), expected(GRID_CELLS), actual(GRID_CELLS);
+  std::chrono::steady_clock::time_point start;
+  double seconds[3];  // scalar, SSE2, AVX2
+  unsigned long long state = 1;
+  long mismatches = 0, n;
+  volatile int sink = 0;
+  int trial, op, i;
+  size_t t;
+
+#ifdef GRID_KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2"))
+  {
+    tables.push_back(&sse2Kernels);
+  }
+  if (__builtin_cpu_supports("avx2"))
+  {
+    tables.push_back(&avx2Kernels);
+  }
+#endif
+
+  for (trial = 0; trial < 1000; trial++)
+  {
+    for (i = 0; i < GRID_CELLS; i++)
+    {
+      source[i] = randomKernelValue(&state);
+      other[i] = randomKernelValue(&state);
+      if (trial % 100 == 0)
+      {
+        source[i] = -(source[i] & 3);  // no positive cell at all
+      }
+    }
+    for (op = 0; op < NUMBER_KERNEL_OPS; op++)
+    {
+      for (t = 1; t < tables.size(); t++)
+      {
+        expected = source;
+        actual = source;
+        if (runGridKernel(&scalarKernels, op, expected.data(), other.data()) !=
+                runGridKernel(tables[t], op, actual.data(), other.data()) ||
+            expected != actual)
+        {
+          mismatches++;
+        }
+      }
+    }
+  }
+
+  fprintf(report, "# %li calls per kernel\n", rounds);
+  for (op = 0; op < NUMBER_KERNEL_OPS; op++)
+  {
+    fprintf(report, "%-15s", opNames[op]);
+    for (t = 0; t < tables.size(); t++)
+    {
+      actual = source;
+      start = std::chrono::steady_clock::now();
+      for (n = 0; n < rounds; n++)
+      {
+        sink = sink + runGridKernel(tables[t], op, actual.data(), other.data());
+      }
+      seconds[t] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      fprintf(report, "  %s %7.3f us/call", tables[t]->name, 1e6 * seconds[t] / max(1, rounds));
+    }
+    fprintf(report, "  %5.2fx\n", seconds[0] / max(1e-9, seconds[tables.size() - 1]));
+  }
+  fprintf(report, "# %li mismatched\n", mismatches);
+  return mismatches;
+}
@@ -24,6 +24,8 @@
 #include <math.h>
 #include <time.h>
 
+#include <chrono>
+
 #include "IncludeGlobals.h"
 #include "Rogue.h"
 
@@ -167,15 +169,12 @@ void getClosestValidLocationOnMap(int loc[2], int** map, int x, int y)
   }
 }
 
-void processSnapMap(int** map)
+// costMap is the player's, from populateCreatureCostMap().
+void processSnapMap(int** map, int** costMap)
 {
-  int** costMap;
   enum Directions dir;
   int i, j, newX, newY;
 
-  costMap = allocGrid();
-
-  populateCreatureCostMap(costMap, &player);
   fillGrid(map, 30000);
   map[player.xLoc][player.yLoc] = 0;
   dijkstraScan(map, costMap, true);
@@ -197,8 +196,6 @@ void processSnapMap(int** map)
       }
     }
   }
-
-  freeGrid(costMap);
 }
 
 // Displays a menu of buttons for various commands.
@@ -677,7 +674,7 @@ void mainInputLoop()
     fillGrid(playerPathingMap, 30000);
     playerPathingMap[player.xLoc][player.yLoc] = 0;
     dijkstraScan(playerPathingMap, costMap, true);
-    processSnapMap(cursorSnapMap);
+    processSnapMap(cursorSnapMap, costMap);
 
     do
     {
@@ -972,6 +969,26 @@ void considerCautiousMode()
   }*/
 }
 
+// The columns of each row that might hold cells needing an update, from dirtyStart up to but not
+// including dirtyEnd; empty when they're equal. commitDraws() only looks inside them.
+static thread_local short dirtyStart[ROWS], dirtyEnd[ROWS];
+
+// Flags one cell of the window as needing to be redrawn at next flush.
+void markScreenCellForUpdate(int x, int y)
+{
+  displayBuffer[x][y].needsUpdate = true;
+  if (dirtyStart[y] == dirtyEnd[y])
+  {
+    dirtyStart[y] = x;
+    dirtyEnd[y] = x + 1;
+  }
+  else
+  {
+    dirtyStart[y] = min(dirtyStart[y], x);
+    dirtyEnd[y] = max(dirtyEnd[y], x + 1);
+  }
+}
+
 // flags the entire window as needing to be redrawn at next flush.
 // very low level -- does not interface with the guts of the game.
 void refreshScreen()
@@ -985,6 +1002,11 @@ void refreshScreen()
       displayBuffer[i][j].needsUpdate = true;
     }
   }
+  for (j = 0; j < ROWS; j++)
+  {
+    dirtyStart[j] = 0;
+    dirtyEnd[j] = COLS;
+  }
   commitDraws();
 }
 
@@ -1157,8 +1179,222 @@ void normColor(Color* baseColor, const int aggregateMultiplier, const int colorT
   baseColor->rand = 0;
 }
 
-// okay, this is kind of a beast...
+// Everything that goes into the appearance of a visible cell with nothing on it.
+struct CellAppearanceKey
+{
+  unsigned long flags;
+  enum TileType layers[NUMBER_TERRAIN_LAYERS];
+  unsigned int volume;
+  int light[3];
+  int randomValues[8];
+  char detail;
+  bool trueColorMode, playbackOmniscience, inWater;
+  int cursorPathIntensity;
+};
+
+struct CellAppearance
+{
+  bool valid;
+  CellAppearanceKey key;
+  uchar character;
+  Color foreColor, backColor;
+};
+
+static thread_local CellAppearance cellAppearances[DCOLS][DROWS];
+
+static void getCellAppearanceKey(int x, int y, CellAppearanceKey* key)
+{
+  memset(key, 0, sizeof(*key)); // so that padding compares equal
+  key->flags = pmap[x][y].flags;
+  memcpy(key->layers, pmap[x][y].layers, sizeof(key->layers));
+  key->volume = pmap[x][y].volume;
+  memcpy(key->light, tmap[x][y].light, sizeof(key->light));
+  memcpy(key->randomValues, terrainRandomValues[x][y], sizeof(key->randomValues));
+  key->detail = displayDetail[x][y];
+  key->trueColorMode = rogue.trueColorMode;
+  key->playbackOmniscience = rogue.playbackOmniscience;
+  key->inWater = rogue.inWater;
+  key->cursorPathIntensity = rogue.cursorPathIntensity;
+}
+
+// Whether the cell's appearance is down to its key alone: it has to be in view, with no creature or
+// item to look up and no hallucinating or stealth range display to draw on the cosmetic RNG or the
+// scent map. That covers most of what the field of view and the gas redraw each turn.
+static bool cellAppearanceIsCacheable(int x, int y)
+{
+  return (pmap[x][y].flags & VISIBLE) &&
+         !(pmap[x][y].flags & (HAS_MONSTER | HAS_DORMANT_MONSTER | HAS_ITEM | HAS_PLAYER | ITEM_DETECTED)) &&
+         !player.status[STATUS_HALLUCINATING] && !rogue.displayAggroRangeMode && !D_SCENT_VISION;
+}
+
+// The colors behind the tiles change from level to level (see updateColors()).
+void forgetCellAppearances()
+{
+  int i, j;
+
+  for (i = 0; i < DCOLS; i++)
+  {
+    for (j = 0; j < DROWS; j++)
+    {
+      cellAppearances[i][j].valid = false;
+    }
+  }
+}
+
+static void workOutCellAppearance(int x, int y, uchar* returnChar, Color* returnForeColor,
+                                  Color* returnBackColor);
+
+// The appearance of a cell whose key hasn't changed since it was last worked out is the same as it was.
 void getCellAppearance(int x, int y, uchar* returnChar, Color* returnForeColor, Color* returnBackColor)
+{
+  CellAppearance* cached = &cellAppearances[x][y];
+  CellAppearanceKey key;
+  const bool cacheable = cellAppearanceIsCacheable(x, y);
+
+  if (cacheable && cached->valid)
+  {
+    getCellAppearanceKey(x, y, &key);
+    if (!memcmp(&key, &cached->key, sizeof(key)))
+    {
+      *returnChar = cached->character;
+      *returnForeColor = cached->foreColor;
+      *returnBackColor = cached->backColor;
+      return;
+    }
+  }
+
+  workOutCellAppearance(x, y, returnChar, returnForeColor, returnBackColor);
+
+  if (cacheable)
+  {
+    // Keyed after the fact: baking the colors sets or clears TERRAIN_COLORS_DANCING.
+    getCellAppearanceKey(x, y, &cached->key);
+    cached->character = *returnChar;
+    cached->foreColor = *returnForeColor;
+    cached->backColor = *returnBackColor;
+    cached->valid = true;
+  }
+}
+
+// What every cell of the map looks like, by one of the two ways benchmarkCellAppearance() compares.
+struct MapAppearance
+{
+  uchar character[DCOLS][DROWS];
+  Color foreColor[DCOLS][DROWS], backColor[DCOLS][DROWS];
+};
+
+struct AppearanceTimings
+{
+  double uncachedSeconds;
+  double cachedSeconds;
+  long passes;
+  long cells;
+  long cacheableCells;
+  long mismatches;
+};
+
+static bool colorsMatch(const Color* a, const Color* b)
+{
+  return a->red == b->red && a->green == b->green && a->blue == b->blue && a->redRand == b->redRand &&
+         a->greenRand == b->greenRand && a->blueRand == b->blueRand && a->rand == b->rand &&
+         a->colorDances == b->colorDances;
+}
+
+// Works out the whole map from scratch and then through the cache, as displayLevel() would, times
+// each pass and counts the cells whose appearances differ.
+static void timeCellAppearances(AppearanceTimings* timings, MapAppearance* uncached, MapAppearance* cached)
+{
+  std::chrono::steady_clock::time_point start;
+  int i, j;
+
+  start = std::chrono::steady_clock::now();
+  for (i = 0; i < DCOLS; i++)
+  {
+    for (j = 0; j < DROWS; j++)
+    {
+      workOutCellAppearance(i, j, &uncached->character[i][j], &uncached->foreColor[i][j], &uncached->backColor[i][j]);
+    }
+  }
+  timings->uncachedSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  start = std::chrono::steady_clock::now();
+  for (i = 0; i < DCOLS; i++)
+  {
+    for (j = 0; j < DROWS; j++)
+    {
+      getCellAppearance(i, j, &cached->character[i][j], &cached->foreColor[i][j], &cached->backColor[i][j]);
+    }
+  }
+  timings->cachedSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  timings->passes++;
+  for (i = 0; i < DCOLS; i++)
+  {
+    for (j = 0; j < DROWS; j++)
+    {
+      timings->cells++;
+      timings->cacheableCells += cellAppearanceIsCacheable(i, j);
+      if (uncached->character[i][j] != cached->character[i][j] ||
+          !colorsMatch(&uncached->foreColor[i][j], &cached->foreColor[i][j]) ||
+          !colorsMatch(&uncached->backColor[i][j], &cached->backColor[i][j]))
+      {
+        timings->mismatches++;
+      }
+    }
+  }
+}
+
+// Generates the first depth levels of count seeds from firstSeed and lets turnCount turns of fire, gas
+// and flickering light go by on each. After every turn, times a redraw of the whole map with and
+// without the appearance cache and writes the per-pass latencies to report. Returns the number of
+// cells whose cached appearance was wrong, which should always be zero.
+long benchmarkCellAppearance(unsigned long firstSeed, int seedCount, int depth, int turnCount, FILE* report)
+{
+  AppearanceTimings timings = { 0, 0, 0, 0, 0, 0 };
+  MapAppearance* uncached = new MapAppearance;
+  MapAppearance* cached = new MapAppearance;
+  char path[BROGUE_FILENAME_MAX];
+  unsigned long theSeed;
+  int turn;
+
+  getAvailableFilePath(path, LAST_GAME_NAME, GAME_SUFFIX);
+  strcat(path, GAME_SUFFIX);
+
+  for (theSeed = firstSeed; theSeed < firstSeed + seedCount; theSeed++)
+  {
+    rogue.nextGamePath[0] = '\0';
+    rogue.playbackMode = false;
+    rogue.playbackBetweenTurns = false;
+    strcpy(currentFilePath, path);
+    initializeRogue(theSeed);
+    for (rogue.depthLevel = 1; rogue.depthLevel <= depth; rogue.depthLevel++)
+    {
+      startLevel(rogue.depthLevel == 1 ? 1 : rogue.depthLevel - 1, 1);
+      for (turn = 0; turn < turnCount; turn++)
+      {
+        updateEnvironment();
+        updateVision(true);
+        timeCellAppearances(&timings, uncached, cached);
+      }
+    }
+    freeEverything();
+    remove(currentFilePath);
+  }
+  delete uncached;
+  delete cached;
+
+  fprintf(report, "# %i seeds, depths 1 to %i, %i turns each; %.1f%% of cells cacheable\n", seedCount, depth,
+          turnCount, 100.0 * timings.cacheableCells / max(1, timings.cells));
+  fprintf(report, "%-12s %7li passes  from scratch %8.2f us/pass  cached %8.2f us/pass  %5.2fx  %li mismatched\n",
+          "whole map", timings.passes, 1e6 * timings.uncachedSeconds / max(1, timings.passes),
+          1e6 * timings.cachedSeconds / max(1, timings.passes),
+          timings.uncachedSeconds / max(1e-9, timings.cachedSeconds), timings.mismatches);
+  return timings.mismatches;
+}
+
+// okay, this is kind of a beast...
+static void workOutCellAppearance(int x, int y, uchar* returnChar, Color* returnForeColor,
+                                  Color* returnBackColor)
 {
   int bestBCPriority, bestFCPriority, bestCharPriority;
   int distance;
@@ -2003,7 +2239,7 @@ void plotCharWithColor(uchar inputChar, int xLoc, int yLoc, const Color* cellFor
       backGreen != displayBuffer[xLoc][yLoc].backColorComponents[1] ||
       backBlue != displayBuffer[xLoc][yLoc].backColorComponents[2])
   {
-    displayBuffer[xLoc][yLoc].needsUpdate = true;
+    markScreenCellForUpdate(xLoc, yLoc);
 
     displayBuffer[xLoc][yLoc].character = inputChar;
     displayBuffer[xLoc][yLoc].foreColorComponents[0] = foreRed;
@@ -2052,23 +2288,33 @@ void plotCharToBuffer(uchar inputChar, int x, int y, Color* foreColor, Color* ba
 
 // Set to false and draws don't take effect, they simply queue up. Set to true and all of the
 // queued up draws take effect.
+// Only the dirty span of each row is looked at, and its changed cells go to the platform a run at a time.
 void commitDraws()
 {
-  int i, j;
+  cellDisplayBuffer run[COLS];
+  int i, j, length;
 
-  for (i = 0; i < COLS; i++)
+  for (j = 0; j < ROWS; j++)
   {
-    for (j = 0; j < ROWS; j++)
+    length = 0;
+    for (i = dirtyStart[j]; i < dirtyEnd[j]; i++)
     {
       if (displayBuffer[i][j].needsUpdate)
       {
-        plotChar(displayBuffer[i][j].character, i, j, displayBuffer[i][j].foreColorComponents[0],
-                 displayBuffer[i][j].foreColorComponents[1], displayBuffer[i][j].foreColorComponents[2],
-                 displayBuffer[i][j].backColorComponents[0], displayBuffer[i][j].backColorComponents[1],
-                 displayBuffer[i][j].backColorComponents[2]);
         displayBuffer[i][j].needsUpdate = false;
+        run[length++] = displayBuffer[i][j];
+      }
+      else if (length)
+      {
+        plotCharRun(i - length, j, length, run);
+        length = 0;
       }
     }
+    if (length)
+    {
+      plotCharRun(i - length, j, length, run);
+    }
+    dirtyStart[j] = dirtyEnd[j] = 0;
   }
 }
 
@@ -2137,7 +2383,7 @@ void hiliteCharGrid(char hiliteCharGrid[DCOLS][DROWS], Color* hiliteColor, int h
         x = mapToWindowX(i);
         y = mapToWindowY(j);
 
-        displayBuffer[x][y].needsUpdate = true;
+        markScreenCellForUpdate(x, y);
         displayBuffer[x][y].backColorComponents[0] =
             clamp(displayBuffer[x][y].backColorComponents[0] + hCol.red * hiliteStrength / 100, 0, 100);
         displayBuffer[x][y].backColorComponents[1] =
@@ -2708,6 +2954,10 @@ bool pauseBrogue(int milliseconds)
 {
   bool interrupted;
 
+  if (rogue.playbackHeadless)
+  {
+    return true;  // nothing is drawn, and the console may belong to a game on another thread
+  }
   commitDraws();
   if (rogue.playbackMode && rogue.playbackFastForward)
   {
@@ -2735,7 +2985,8 @@ void nextBrogueEvent(RogueEvent* returnEvent, bool textInput, bool colorsDance,
     do
     {
       repeatAgain = false;
-      if ((!rogue.playbackFastForward && rogue.playbackBetweenTurns) || rogue.playbackOOS)
+      if (((!rogue.playbackFastForward && rogue.playbackBetweenTurns) || rogue.playbackOOS) &&
+          !rogue.playbackHeadless)
       {
         pauseDuration = (rogue.playbackPaused ? DEFAULT_PLAYBACK_DELAY : rogue.playbackDelayThisTurn);
         if (pauseDuration && pauseBrogue(pauseDuration))
@@ -2750,6 +3001,15 @@ void nextBrogueEvent(RogueEvent* returnEvent, bool textInput, bool colorsDance,
     rogue.playbackDelayThisTurn = rogue.playbackDelayPerTurn;
     recallEvent(returnEvent);
   }
+  else if (rogue.playbackHeadless)
+  {
+    // Nobody is at the keyboard, and the console may belong to a game on another thread.
+    rogue.gameHasEnded = true;
+    returnEvent->eventType = KEYSTROKE;
+    returnEvent->param1 = ESCAPE_KEY;
+    returnEvent->param2 = 0;
+    returnEvent->controlKey = returnEvent->shiftKey = false;
+  }
   else
   {
     commitDraws();
@@ -3390,6 +3650,10 @@ void dequeueEvent()
   nextBrogueEvent(&returnEvent, false, false, true);
 }
 
+// The lines that displayMessageArchive() scrolls through, oldest first from messageArchivePosition.
+thread_local char messageArchive[MESSAGE_ARCHIVE_LINES][COLS * 2];
+thread_local int messageArchivePosition;
+
 void displayMessageArchive()
 {
   int i, j, k, reverse, fadePercent, totalMessageCount, currentMessageCount;
@@ -4776,7 +5040,7 @@ void highlightScreenCell(int x, int y, Color* highlightColor, int strength)
   applyColorAugment(&tempColor, highlightColor, strength);
   storeColorComponents(displayBuffer[x][y].backColorComponents, &tempColor);
 
-  displayBuffer[x][y].needsUpdate = true;
+  markScreenCellForUpdate(x, y);
 }
 
 int estimatedArmorValue()
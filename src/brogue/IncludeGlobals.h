@@ -21,55 +21,62 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+// Standard headers come before Rogue.h, whose min() and max() macros would break them.
+#include <vector>
+
 #include "Rogue.h"
+#include "GameContext.h"
+
+// Declarations marked thread_local hold the state of one game; see GameContext.h.
 
-extern TCell tmap[DCOLS][DROWS];  // grids with info about the map
-extern pcell pmap[DCOLS][DROWS];  // grids with info about the map
-extern int** scentMap;
-extern cellDisplayBuffer displayBuffer[COLS][ROWS];
-extern int terrainRandomValues[DCOLS][DROWS][8];
-extern int** safetyMap;  // used to help monsters flee
-extern int** allySafetyMap;
-extern int** chokeMap;
+extern thread_local TCell tmap[DCOLS][DROWS];  // grids with info about the map
+extern thread_local pcell pmap[DCOLS][DROWS];  // grids with info about the map
+extern thread_local TerrainFlagCache terrainFlagCache;  // the flags of pmap's layers, combined
+extern thread_local int** scentMap;
+extern thread_local cellDisplayBuffer displayBuffer[COLS][ROWS];
+extern thread_local int terrainRandomValues[DCOLS][DROWS][8];
+extern thread_local int** safetyMap;  // used to help monsters flee
+extern thread_local int** allySafetyMap;
+extern thread_local int** chokeMap;
 
 // extern const int nbDirs[8][2];
 extern const int cDirs[8][2];
-extern LevelData* levels;
-extern Creature player;
-extern PlayerCharacter rogue;
-extern Creature* monsters;
-extern Creature* dormantMonsters;
-extern Creature* graveyard;
-extern Creature* purgatory;
-extern Item* floorItems;
-extern Item* packItems;
-extern Item* monsterItemsHopper;
-extern int numberOfWaypoints;
-
-extern char displayedMessage[MESSAGE_LINES][COLS];
-extern bool messageConfirmed[3];
-extern char combatText[COLS];
-int messageArchivePosition;
-char messageArchive[MESSAGE_ARCHIVE_LINES][COLS * 2];
-
-extern char currentFilePath[BROGUE_FILENAME_MAX];
-extern unsigned long randomNumbersGenerated;
-
-extern char displayDetail[DCOLS][DROWS];
+extern thread_local LevelData* levels;
+extern thread_local Creature player;
+extern thread_local PlayerCharacter rogue;
+extern thread_local Creature* monsters;
+extern thread_local Creature* dormantMonsters;
+extern thread_local Creature* graveyard;
+extern thread_local Creature* purgatory;
+extern thread_local Item* floorItems;
+extern thread_local Item* packItems;
+extern thread_local Item* monsterItemsHopper;
+extern thread_local int numberOfWaypoints;
+
+extern thread_local char displayedMessage[MESSAGE_LINES][COLS];
+extern thread_local bool messageConfirmed[3];
+extern thread_local char combatText[COLS];
+extern thread_local int messageArchivePosition;
+extern thread_local char messageArchive[MESSAGE_ARCHIVE_LINES][COLS * 2];
+
+extern thread_local char currentFilePath[BROGUE_FILENAME_MAX];
+extern thread_local unsigned long randomNumbersGenerated;
+
+extern thread_local char displayDetail[DCOLS][DROWS];
 
 #ifdef AUDIT_RNG
 extern FILE* RNGLogFile;
 #endif
 
-extern unsigned char inputRecordBuffer[INPUT_RECORD_BUFFER + 100];
-extern unsigned int locationInRecordingBuffer;
+extern thread_local unsigned char inputRecordBuffer[max(INPUT_RECORD_BUFFER, PLAYBACK_READ_BUFFER) + 100];
+extern thread_local unsigned int locationInRecordingBuffer;
 
-extern unsigned long positionInPlaybackFile;
-extern unsigned long lengthOfPlaybackFile;
-extern unsigned long recordingLocation;
-extern unsigned long maxLevelChanges;
-extern char annotationPathname[BROGUE_FILENAME_MAX];  // pathname of annotation file
-extern unsigned long previousGameSeed;
+extern thread_local unsigned long positionInPlaybackFile;
+extern thread_local unsigned long lengthOfPlaybackFile;
+extern thread_local unsigned long recordingLocation;
+extern thread_local unsigned long maxLevelChanges;
+extern thread_local char annotationPathname[BROGUE_FILENAME_MAX];  // pathname of annotation file
+extern thread_local unsigned long previousGameSeed;
 
 // basic colors
 extern Color white;
@@ -103,17 +110,17 @@ extern Color undiscoveredColor;
 extern Color wallForeColor;
 extern Color wallBackColorStart;
 extern Color wallBackColorEnd;
-extern Color wallBackColor;
+extern thread_local Color wallBackColor;  // updateColors() sets this and the other dynamic colors per depth
 extern Color graniteBackColor;
 extern Color floorForeColor;
 extern Color floorBackColor;
 extern Color doorForeColor;
 extern Color doorBackColor;
 
-extern Color deepWaterForeColor;
-extern Color deepWaterBackColor;
-extern Color shallowWaterForeColor;
-extern Color shallowWaterBackColor;
+extern thread_local Color deepWaterForeColor;
+extern thread_local Color deepWaterBackColor;
+extern thread_local Color shallowWaterForeColor;
+extern thread_local Color shallowWaterBackColor;
 extern Color mudForeColor;
 extern Color mudBackColor;
 extern Color chasmForeColor;
@@ -121,7 +128,7 @@ extern Color chasmEdgeBackColor;
 extern Color fireForeColor;
 
 // light colors
-extern Color minersLightColor;
+extern thread_local Color minersLightColor;
 extern Color minersLightStartColor;
 extern Color minersLightEndColor;
 extern Color torchLightColor;
@@ -180,20 +187,20 @@ extern const Color flameTitleColor;
 
 extern const Color superVictoryColor;
 
-extern Color* dynamicColors[NUMBER_DYNAMIC_COLORS][3];
+extern thread_local Color* dynamicColors[NUMBER_DYNAMIC_COLORS][3];
 
 extern const AutoGenerator autoGeneratorCatalog[NUMBER_AUTOGENERATORS];
 
-extern FloorTileType tileCatalog[NUMBER_TILETYPES];
+extern thread_local FloorTileType tileCatalog[NUMBER_TILETYPES];  // points at the dynamic colors
 
-extern DungeonFeature dungeonFeatureCatalog[NUMBER_DUNGEON_FEATURES];
+extern thread_local DungeonFeature dungeonFeatureCatalog[NUMBER_DUNGEON_FEATURES];
 extern DungeonProfile dungeonProfileCatalog[NUMBER_DUNGEON_PROFILES];
 
-extern LightSource lightCatalog[NUMBER_LIGHT_KINDS];
+extern thread_local LightSource lightCatalog[NUMBER_LIGHT_KINDS];  // likewise
 
 extern const blueprint blueprintCatalog[NUMBER_BLUEPRINTS];
 
-extern CreatureType monsterCatalog[NUMBER_MONSTER_KINDS];
+extern thread_local CreatureType monsterCatalog[NUMBER_MONSTER_KINDS];
 extern MonsterWords monsterText[NUMBER_MONSTER_KINDS];
 extern HordeType hordeCatalog[NUMBER_HORDES];
 extern const Mutation mutationCatalog[NUMBER_MUTATORS];
@@ -202,28 +209,28 @@ extern const MonsterClass MonsterClassCatalog[MONSTER_CLASS_COUNT];
 extern const Feature featTable[FEAT_COUNT];
 
 // ITEMS
-extern char itemTitles[NUMBER_SCROLL_KINDS][30];
+extern thread_local char itemTitles[NUMBER_SCROLL_KINDS][30];
 extern char titlePhonemes[NUMBER_TITLE_PHONEMES][30];
-extern char itemColors[NUMBER_ITEM_COLORS][30];
-extern char itemWoods[NUMBER_ITEM_WOODS][30];
-extern char itemMetals[NUMBER_ITEM_METALS][30];
-extern char itemGems[NUMBER_ITEM_GEMS][30];
+extern thread_local char itemColors[NUMBER_ITEM_COLORS][30];
+extern thread_local char itemWoods[NUMBER_ITEM_WOODS][30];
+extern thread_local char itemMetals[NUMBER_ITEM_METALS][30];
+extern thread_local char itemGems[NUMBER_ITEM_GEMS][30];
 
 extern char itemColorsRef[NUMBER_ITEM_COLORS][30];
 extern char itemWoodsRef[NUMBER_ITEM_WOODS][30];
 extern char itemMetalsRef[NUMBER_ITEM_METALS][30];
 extern char itemGemsRef[NUMBER_ITEM_GEMS][30];
 
-extern ItemTable keyTable[NUMBER_KEY_TYPES];
-extern ItemTable foodTable[NUMBER_FOOD_KINDS];
-extern ItemTable weaponTable[NUMBER_WEAPON_KINDS];
-extern ItemTable armorTable[NUMBER_ARMOR_KINDS];
-extern ItemTable scrollTable[NUMBER_SCROLL_KINDS];
-extern ItemTable potionTable[NUMBER_POTION_KINDS];
-extern ItemTable wandTable[NUMBER_WAND_KINDS];
-extern ItemTable staffTable[NUMBER_STAFF_KINDS];
-extern ItemTable ringTable[NUMBER_RING_KINDS];
-extern ItemTable charmTable[NUMBER_CHARM_KINDS];
+extern thread_local ItemTable keyTable[NUMBER_KEY_TYPES];
+extern thread_local ItemTable foodTable[NUMBER_FOOD_KINDS];
+extern thread_local ItemTable weaponTable[NUMBER_WEAPON_KINDS];
+extern thread_local ItemTable armorTable[NUMBER_ARMOR_KINDS];
+extern thread_local ItemTable scrollTable[NUMBER_SCROLL_KINDS];
+extern thread_local ItemTable potionTable[NUMBER_POTION_KINDS];
+extern thread_local ItemTable wandTable[NUMBER_WAND_KINDS];
+extern thread_local ItemTable staffTable[NUMBER_STAFF_KINDS];
+extern thread_local ItemTable ringTable[NUMBER_RING_KINDS];
+extern thread_local ItemTable charmTable[NUMBER_CHARM_KINDS];
 
 extern const Bolt boltCatalog[NUMBER_BOLT_KINDS];
 
@@ -3997,6 +3997,7 @@ bool tunnelize(int x, int y)
   if (x == 0 || x == DCOLS - 1 || y == 0 || y == DROWS - 1)
   {
     pmap[x][y].layers[DUNGEON] = CRYSTAL_WALL;  // don't dissolve the boundary walls
+    updateTerrainFlags(x, y);
     didSomething = true;
   }
   else
@@ -4009,6 +4010,7 @@ bool tunnelize(int x, int y)
         didSomething = true;
       }
     }
+    updateTerrainFlags(x, y);
   }
   if (didSomething)
   {
@@ -4591,10 +4593,12 @@ void crystalize(int radius)
         if (i == 0 || i == DCOLS - 1 || j == 0 || j == DROWS - 1)
         {
           pmap[i][j].layers[DUNGEON] = CRYSTAL_WALL;  // don't dissolve the boundary walls
+          updateTerrainFlags(i, j);
         }
         else if (tileCatalog[pmap[i][j].layers[DUNGEON]].flags & (T_OBSTRUCTS_PASSABILITY | T_OBSTRUCTS_VISION))
         {
           pmap[i][j].layers[DUNGEON] = FORCEFIELD;
+          updateTerrainFlags(i, j);
           spawnDungeonFeature(i, j, &dungeonFeatureCatalog[DF_SHATTERING_SPELL], true, false);
 
           if (pmap[i][j].flags & HAS_MONSTER)
@@ -7468,6 +7472,7 @@ void updateIdentifiableItems()
 void magicMapCell(int x, int y)
 {
   pmap[x][y].flags |= MAGIC_MAPPED;
+  markCostMapsDirty(x, y);
   pmap[x][y].rememberedTerrainFlags =
       tileCatalog[pmap[x][y].layers[DUNGEON]].flags | tileCatalog[pmap[x][y].layers[LIQUID]].flags;
   pmap[x][y].rememberedTMFlags =
@@ -7704,6 +7709,7 @@ void readScroll(Item* theItem)
             discover(i, j);
             magicMapCell(i, j);
             pmap[i][j].flags &= ~(STABLE_MEMORY | DISCOVERED);
+            markCostMapsDirty(i, j);
           }
         }
       }
@@ -24,6 +24,7 @@
 #include <math.h>
 #include "IncludeGlobals.h"
 #include "Rogue.h"
+#include "Grid.h"
 
 void logLights()
 {
@@ -58,20 +59,219 @@ void logLights()
   printf("\n");
 }
 
-// Returns true if any part of the light hit cells that are in the player's field of view.
-bool paintLight(LightSource* theLight, int x, int y, bool isMinersLight, bool maintainShadows)
+#define LIGHT_CONTRIBUTIONS_PER_CELL 4
+
+// A cell that a light reaches, and how strongly: the percentage of the light's color it gets.
+struct LitCell
 {
-  int i, j, k;
-  int colorComponents[3], randComponent, lightMultiplier;
+  int x, y, lightMultiplier;
+};
+
+// A wall the light reaches only if the cell in front of it, (x2, y2), is in the player's field of view.
+// A wall can be reached from more than one cell in front; those entries are kept together.
+struct LitWall
+{
+  int x, y, x2, y2, lightMultiplier;
+};
+
+// Where a light of a given radius and fade at (x, y) falls, the cells its field of view looked at, and
+// which of those blocked. Everything paintLight() works out from the map is here, so while those cells
+// block the same way the light can be painted again without another field of view or square root.
+struct LightContribution
+{
+  int radius;  // in hundredths, as rolled
   int fadeToPercent;
-  double radius;
+  unsigned long forbiddenFlags;
+  bool cautiousOnWalls;
+  CellSet tested, blockers;  // blockers only within tested
+  std::vector<LitCell> cells;
+  std::vector<LitWall> walls;
+  unsigned long lastUse;
+};
+
+static thread_local std::vector<LightContribution> lightContributions[DCOLS][DROWS];
+static thread_local LightContribution minersLightContribution;
+static thread_local unsigned long lightClock;
+
+// The cells with a creature in them, found once for all the lights updateLighting() paints.
+static thread_local CellSet creatureCells;
+static thread_local bool creatureCellsKnown;
+
+static void workOutLightContribution(LightContribution* contribution, int x, int y)
+{
+  const double radius = contribution->radius / 100.0;
+  std::vector<FOVWallCell> walls;
   char grid[DCOLS][DROWS];
-  bool dispelShadows, overlappedFieldOfView;
+  int i, j, lightMultiplier;
+
+  contribution->cells.clear();
+  contribution->walls.clear();
+
+  memset(grid, 0, sizeof(grid));
+  if (contribution->cautiousOnWalls)
+  {
+    contribution->tested.clear();
+    getCautiousFOVMask(grid, x, y, radius, &contribution->blockers, &walls, &contribution->tested);
+    for (i = 0; i < DCOLS; i++)
+    {
+      contribution->blockers.columns[i] &= contribution->tested.columns[i];
+    }
+  }
+  else
+  {
+    getFOVMask(grid, x, y, radius, T_OBSTRUCTS_VISION, contribution->forbiddenFlags, false);
+  }
+  for (const FOVWallCell& wall : walls)
+  {
+    if (!grid[wall.x][wall.y])
+    {
+      grid[wall.x][wall.y] = 2;
+    }
+  }
+
+  for (i = max(0, x - (radius + FLOAT_FUDGE)); i < DCOLS && i < x + radius; i++)
+  {
+    for (j = max(0, y - (radius + FLOAT_FUDGE)); j < DROWS && j < y + radius; j++)
+    {
+      if (grid[i][j])
+      {
+        lightMultiplier = 100 - (100 - contribution->fadeToPercent) *
+                                    (sqrt((i - x) * (i - x) + (j - y) * (j - y)) / radius + FLOAT_FUDGE);
+        if (grid[i][j] == 1)
+        {
+          contribution->cells.push_back({i, j, lightMultiplier});
+        }
+        else
+        {
+          for (const FOVWallCell& wall : walls)
+          {
+            if (wall.x == i && wall.y == j)
+            {
+              contribution->walls.push_back({i, j, wall.x2, wall.y2, lightMultiplier});
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Whether the cells that decided a contribution still block the way they did.
+static bool sameBlockers(const LightContribution* contribution, const CellSet* blockers)
+{
+  int i;
+
+  for (i = 0; i < DCOLS; i++)
+  {
+    if ((blockers->columns[i] & contribution->tested.columns[i]) != contribution->blockers.columns[i])
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The contribution of a light at (x, y), from the cache if the cells its field of view looked at haven't
+// changed since it was last worked out.
+static const LightContribution* lightContribution(int x, int y, int radius, int fadeToPercent,
+                                                  unsigned long forbiddenFlags, bool cautiousOnWalls)
+{
+  std::vector<LightContribution>& cached = lightContributions[x][y];
+  LightContribution* contribution = nullptr;
+  CellSet blockers;
+
+  getFOVBlockers(&blockers, x, y, radius / 100.0, T_OBSTRUCTS_VISION, forbiddenFlags,
+                 (creatureCellsKnown && forbiddenFlags == (HAS_MONSTER | HAS_PLAYER) ? &creatureCells : nullptr));
+
+  for (LightContribution& candidate : cached)
+  {
+    if (candidate.radius == radius && candidate.fadeToPercent == fadeToPercent &&
+        candidate.forbiddenFlags == forbiddenFlags && candidate.cautiousOnWalls == cautiousOnWalls)
+    {
+      contribution = &candidate;
+      break;
+    }
+  }
+  if (contribution == nullptr)
+  {
+    if (cached.size() < LIGHT_CONTRIBUTIONS_PER_CELL)
+    {
+      cached.emplace_back();
+      contribution = &cached.back();
+    }
+    else
+    {
+      contribution = &cached[0];
+      for (LightContribution& candidate : cached)
+      {
+        if (candidate.lastUse < contribution->lastUse)
+        {
+          contribution = &candidate;
+        }
+      }
+    }
+    contribution->radius = radius;
+    contribution->fadeToPercent = fadeToPercent;
+    contribution->forbiddenFlags = forbiddenFlags;
+    contribution->cautiousOnWalls = cautiousOnWalls;
+    contribution->blockers = blockers;
+    workOutLightContribution(contribution, x, y);
+  }
+  else if (!sameBlockers(contribution, &blockers))
+  {
+    contribution->blockers = blockers;
+    workOutLightContribution(contribution, x, y);
+  }
+  contribution->lastUse = ++lightClock;
+  return contribution;
+}
+
+// Lights cached for the last level are no use on the next one.
+void forgetLightContributions()
+{
+  int i, j;
+
+  for (i = 0; i < DCOLS; i++)
+  {
+    for (j = 0; j < DROWS; j++)
+    {
+      lightContributions[i][j].clear();
+    }
+  }
+}
+
+static void lightCell(int x, int y, const int colorComponents[3], int lightMultiplier, bool dispelShadows,
+                      bool* overlappedFieldOfView)
+{
+  int k;
+
+  for (k = 0; k < 3; k++)
+  {
+    tmap[x][y].light[k] += colorComponents[k] * lightMultiplier / 100;
+  }
+  if (dispelShadows)
+  {
+    pmap[x][y].flags &= ~IS_IN_SHADOW;
+  }
+  if (pmap[x][y].flags & (IN_FIELD_OF_VIEW | ANY_KIND_OF_VISIBLE))
+  {
+    *overlappedFieldOfView = true;
+  }
+}
+
+// Returns true if any part of the light hit cells that are in the player's field of view.
+// The random radius and color are rolled every time, so the substantive RNG sees the same calls whether
+// or not where the light falls is already known.
+bool paintLight(LightSource* theLight, int x, int y, bool isMinersLight, bool maintainShadows)
+{
+  const LightContribution* contribution;
+  int colorComponents[3], randComponent, radius;
+  bool dispelShadows, overlappedFieldOfView, wallLit;
+  size_t i, first;
 
   brogueAssert(rogue.RNG == RNG_SUBSTANTIVE);
 
   radius = randClump(theLight->lightRadius);
-  radius /= 100;
 
   randComponent = rand_range(0, theLight->lightColor->rand);
   colorComponents[0] = randComponent + theLight->lightColor->red + rand_range(0, theLight->lightColor->redRand);
@@ -82,45 +282,46 @@ bool paintLight(LightSource* theLight, int x, int y, bool isMinersLight, bool ma
   // so the player can be in shadow despite casting his own light.
   dispelShadows = !maintainShadows && (colorComponents[0] + colorComponents[1] + colorComponents[2]) > 0;
 
-  fadeToPercent = theLight->radialFadeToPercent;
-
-  // zero out only the relevant rectangle of the grid
-  for (i = max(0, x - (radius + FLOAT_FUDGE)); i < DCOLS && i < x + radius + FLOAT_FUDGE; i++)
+  if (isMinersLight)
   {
-    for (j = max(0, y - (radius + FLOAT_FUDGE)); j < DROWS && j < y + radius + FLOAT_FUDGE; j++)
-    {
-      grid[i][j] = 0;
-    }
+    // The miner's light moves with the player and reaches most of the map, so it isn't kept.
+    minersLightContribution.radius = radius;
+    minersLightContribution.fadeToPercent = theLight->radialFadeToPercent;
+    minersLightContribution.forbiddenFlags = (theLight->passThroughCreatures ? 0 : (HAS_MONSTER | HAS_PLAYER));
+    minersLightContribution.cautiousOnWalls = false;
+    workOutLightContribution(&minersLightContribution, x, y);
+    contribution = &minersLightContribution;
+  }
+  else
+  {
+    contribution = lightContribution(x, y, radius, theLight->radialFadeToPercent,
+                                     (theLight->passThroughCreatures ? 0 : (HAS_MONSTER | HAS_PLAYER)), true);
   }
-
-  getFOVMask(grid, x, y, radius, T_OBSTRUCTS_VISION, (theLight->passThroughCreatures ? 0 : (HAS_MONSTER | HAS_PLAYER)),
-             (!isMinersLight));
 
   overlappedFieldOfView = false;
 
-  for (i = max(0, x - (radius + FLOAT_FUDGE)); i < DCOLS && i < x + radius; i++)
+  for (const LitCell& cell : contribution->cells)
   {
-    for (j = max(0, y - (radius + FLOAT_FUDGE)); j < DROWS && j < y + radius; j++)
+    lightCell(cell.x, cell.y, colorComponents, cell.lightMultiplier, dispelShadows, &overlappedFieldOfView);
+  }
+  for (first = 0; first < contribution->walls.size(); first = i)
+  {
+    const LitWall& wall = contribution->walls[first];
+
+    wallLit = false;
+    for (i = first; i < contribution->walls.size() && contribution->walls[i].x == wall.x &&
+                    contribution->walls[i].y == wall.y;
+         i++)
     {
-      if (grid[i][j])
+      if (pmap[contribution->walls[i].x2][contribution->walls[i].y2].flags & IN_FIELD_OF_VIEW)
       {
-        lightMultiplier =
-            100 - (100 - fadeToPercent) * (sqrt((i - x) * (i - x) + (j - y) * (j - y)) / radius + FLOAT_FUDGE);
-        for (k = 0; k < 3; k++)
-        {
-          tmap[i][j].light[k] += colorComponents[k] * lightMultiplier / 100;
-          ;
-        }
-        if (dispelShadows)
-        {
-          pmap[i][j].flags &= ~IS_IN_SHADOW;
-        }
-        if (pmap[i][j].flags & (IN_FIELD_OF_VIEW | ANY_KIND_OF_VISIBLE))
-        {
-          overlappedFieldOfView = true;
-        }
+        wallLit = true;
       }
     }
+    if (wallLit)
+    {
+      lightCell(wall.x, wall.y, colorComponents, wall.lightMultiplier, dispelShadows, &overlappedFieldOfView);
+    }
   }
 
   tmap[x][y].light[0] += colorComponents[0];
@@ -263,6 +464,7 @@ void updateLighting()
   recordOldLights();
 
   // and then zero out Light.
+  creatureCells.clear();
   for (i = 0; i < DCOLS; i++)
   {
     for (j = 0; j < DROWS; j++)
@@ -272,8 +474,13 @@ void updateLighting()
         tmap[i][j].light[k] = 0;
       }
       pmap[i][j].flags |= IS_IN_SHADOW;
+      if (pmap[i][j].flags & (HAS_MONSTER | HAS_PLAYER))
+      {
+        creatureCells.add(i, j);
+      }
     }
   }
+  creatureCellsKnown = true;
 
   // Paint all glowing tiles.
   for (i = 0; i < DCOLS; i++)
@@ -327,6 +534,7 @@ void updateLighting()
 
   // Miner's light:
   paintLight(&rogue.minersLight, player.xLoc, player.yLoc, true, true);
+  creatureCellsKnown = false;
 
   if (player.status[STATUS_INVISIBLE])
   {
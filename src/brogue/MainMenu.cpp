@@ -728,68 +728,183 @@ void scumMonster(Creature* monst, FILE* logFile)
   }
 }
 
-void scum(unsigned long startingSeed, int numberOfSeedsToScan, int scanThroughDepth)
+// Catalogs a single seed into logFile. Every seed is generated from scratch, so the entry for a seed
+// does not depend on which seeds were scanned before it.
+void scumSeed(unsigned long theSeed, int scanThroughDepth, const char* savePath, FILE* logFile)
 {
-  unsigned long theSeed;
-  char path[BROGUE_FILENAME_MAX];
   Item* theItem;
   Creature* monst;
   char buf[500];
-  FILE* logFile;
+  bool headless = rogue.playbackFastForward;
 
-  logFile = fopen("Brogue seed catalog.txt", "w");
-  rogue.nextGame = NG_NOTHING;
+  fprintf(logFile, "\n\nSeed %li:", theSeed);
+  printf("\nScanned seed %li.", theSeed);
+  rogue.nextGamePath[0] = '\0';
+  randomNumbersGenerated = 0;
 
-  getAvailableFilePath(path, LAST_GAME_NAME, GAME_SUFFIX);
+  rogue.playbackMode = false;
+  rogue.playbackFastForward = headless;
+  rogue.playbackBetweenTurns = false;
+
+  strcpy(currentFilePath, savePath);
+  initializeRogue(theSeed);
+  rogue.playbackOmniscience = true;
+  for (rogue.depthLevel = 1; rogue.depthLevel <= scanThroughDepth; rogue.depthLevel++)
+  {
+    startLevel(rogue.depthLevel == 1 ? 1 : rogue.depthLevel - 1,
+               1);  // descending into level n
+    fprintf(logFile, "\n    Depth %i:", rogue.depthLevel);
+    for (theItem = floorItems->nextItem; theItem != nullptr; theItem = theItem->nextItem)
+    {
+      itemName(theItem, buf, true, true, nullptr);
+      upperCase(buf);
+      fprintf(logFile, "\n        %s", buf);
+      if (pmap[theItem->xLoc][theItem->yLoc].machineNumber > 0)
+      {
+        fprintf(logFile, " (vault %i)", pmap[theItem->xLoc][theItem->yLoc].machineNumber);
+      }
+    }
+    for (monst = monsters->nextCreature; monst != nullptr; monst = monst->nextCreature)
+    {
+      scumMonster(monst, logFile);
+    }
+    for (monst = dormantMonsters->nextCreature; monst != nullptr; monst = monst->nextCreature)
+    {
+      scumMonster(monst, logFile);
+    }
+  }
+  freeEverything();
+  remove(currentFilePath);  // Don't add a spurious LastGame file to the brogue
+                            // folder.
+}
+
+struct ScumJob
+{
+  unsigned long startingSeed;
+  int numberOfSeedsToScan;
+  int scanThroughDepth;
+  int workerCount;
+};
+
+static void scumShardPath(char* path, int workerIndex)
+{
+  sprintf(path, "%s.%i", SEED_CATALOG_PATH, workerIndex + 1);
+}
+
+// Catalogs one worker's contiguous shard of the seed range into its own file. Runs on a worker
+// thread, which has a game of its own and never draws to the screen.
+static void scumShard(int workerIndex, void* data)
+{
+  const ScumJob* job = (const ScumJob*)data;
+  char base[BROGUE_FILENAME_MAX], path[BROGUE_FILENAME_MAX], shardPath[BROGUE_FILENAME_MAX];
+  unsigned long theSeed, firstSeed, lastSeed;
+  FILE* shardFile;
+
+  firstSeed = job->startingSeed + (unsigned long)job->numberOfSeedsToScan * workerIndex / job->workerCount;
+  lastSeed = job->startingSeed + (unsigned long)job->numberOfSeedsToScan * (workerIndex + 1) / job->workerCount;
+
+  scumShardPath(shardPath, workerIndex);
+  shardFile = fopen(shardPath, "w");
+  if (shardFile == nullptr)
+  {
+    return;
+  }
+
+  // Each worker gets its own throwaway save file so that workers don't clobber one another.
+  sprintf(base, "%s scum %i", LAST_GAME_NAME, workerIndex + 1);
+  getAvailableFilePath(path, base, GAME_SUFFIX);
   strcat(path, GAME_SUFFIX);
 
+  rogue.playbackFastForward = true;
+  for (theSeed = firstSeed; theSeed < lastSeed; theSeed++)
+  {
+    scumSeed(theSeed, job->scanThroughDepth, path, shardFile);
+  }
+  fclose(shardFile);
+}
+
+// Appends the contents of the file at path to logFile.
+static bool appendShard(const char* path, FILE* logFile)
+{
+  char buf[4096];
+  size_t count;
+  FILE* shardFile;
+
+  shardFile = fopen(path, "r");
+  if (shardFile == nullptr)
+  {
+    return false;
+  }
+  while ((count = fread(buf, 1, sizeof(buf), shardFile)) > 0)
+  {
+    fwrite(buf, 1, count, logFile);
+  }
+  fclose(shardFile);
+  return true;
+}
+
+// Splits the seed range into one contiguous shard per worker thread. Shards are concatenated
+// in seed order, so the catalog is byte-for-byte identical to a serial scan.
+static bool scumInParallel(unsigned long startingSeed, int numberOfSeedsToScan, int scanThroughDepth, int workerCount,
+                           FILE* logFile)
+{
+  char shardPath[BROGUE_FILENAME_MAX];
+  ScumJob job = { startingSeed, numberOfSeedsToScan, scanThroughDepth, workerCount };
+  long catalogStart;
+  int i;
+  bool succeeded = true;
+
+  runGamesInParallel(workerCount, scumShard, &job);
+
+  catalogStart = ftell(logFile);
+  for (i = 0; i < workerCount; i++)
+  {
+    scumShardPath(shardPath, i);
+    if (succeeded && !appendShard(shardPath, logFile))
+    {
+      succeeded = false;
+      fseek(logFile, catalogStart, SEEK_SET);  // the serial scan will write over the partial catalog
+    }
+    remove(shardPath);
+  }
+  return succeeded;
+}
+
+// Writes the seed catalog. With more than one worker, the seed range is scanned by that many
+// headless worker threads; otherwise the seeds are scanned one by one in this process.
+void scum(unsigned long startingSeed, int numberOfSeedsToScan, int scanThroughDepth, int workerCount)
+{
+  unsigned long theSeed;
+  char path[BROGUE_FILENAME_MAX];
+  FILE* logFile;
+
+  logFile = fopen(SEED_CATALOG_PATH, "w");
+  if (logFile == nullptr)
+  {
+    return;
+  }
+  rogue.nextGame = NG_NOTHING;
+
   fprintf(logFile, "Brogue seed catalog, seeds %li to %li, through depth %i.\n\n\
 To play one of these seeds, press control-N from the title screen \
 and enter the seed number. Knowing which items will appear on \
 the first %i depths will, of course, make the game significantly easier.",
           startingSeed, startingSeed + numberOfSeedsToScan - 1, scanThroughDepth, scanThroughDepth);
 
-  for (theSeed = startingSeed; theSeed < startingSeed + numberOfSeedsToScan; theSeed++)
+  workerCount = clamp(min(workerCount, numberOfSeedsToScan), 1, MAX_SCUM_WORKERS);
+  if (workerCount > 1 && scumInParallel(startingSeed, numberOfSeedsToScan, scanThroughDepth, workerCount, logFile))
   {
-    fprintf(logFile, "\n\nSeed %li:", theSeed);
-    printf("\nScanned seed %li.", theSeed);
-    rogue.nextGamePath[0] = '\0';
-    randomNumbersGenerated = 0;
+    fclose(logFile);
+    return;
+  }
 
-    rogue.playbackMode = false;
-    rogue.playbackFastForward = false;
-    rogue.playbackBetweenTurns = false;
+  // Serial scan; also the fallback if a worker could not write its shard.
+  getAvailableFilePath(path, LAST_GAME_NAME, GAME_SUFFIX);
+  strcat(path, GAME_SUFFIX);
 
-    strcpy(currentFilePath, path);
-    initializeRogue(theSeed);
-    rogue.playbackOmniscience = true;
-    for (rogue.depthLevel = 1; rogue.depthLevel <= scanThroughDepth; rogue.depthLevel++)
-    {
-      startLevel(rogue.depthLevel == 1 ? 1 : rogue.depthLevel - 1,
-                 1);  // descending into level n
-      fprintf(logFile, "\n    Depth %i:", rogue.depthLevel);
-      for (theItem = floorItems->nextItem; theItem != nullptr; theItem = theItem->nextItem)
-      {
-        itemName(theItem, buf, true, true, nullptr);
-        upperCase(buf);
-        fprintf(logFile, "\n        %s", buf);
-        if (pmap[theItem->xLoc][theItem->yLoc].machineNumber > 0)
-        {
-          fprintf(logFile, " (vault %i)", pmap[theItem->xLoc][theItem->yLoc].machineNumber);
-        }
-      }
-      for (monst = monsters->nextCreature; monst != nullptr; monst = monst->nextCreature)
-      {
-        scumMonster(monst, logFile);
-      }
-      for (monst = dormantMonsters->nextCreature; monst != nullptr; monst = monst->nextCreature)
-      {
-        scumMonster(monst, logFile);
-      }
-    }
-    freeEverything();
-    remove(currentFilePath);  // Don't add a spurious LastGame file to the brogue
-                              // folder.
+  for (theSeed = startingSeed; theSeed < startingSeed + numberOfSeedsToScan; theSeed++)
+  {
+    scumSeed(theSeed, scanThroughDepth, path, logFile);
   }
   fclose(logFile);
 }
@@ -983,6 +1098,7 @@ void mainBrogueJunction()
               pausePlayback();
             }
 
+            considerCapturingPlaybackKeyframe();
             rogue.RNG = RNG_COSMETIC;  // dancing terrain colors can't influence recordings
             rogue.playbackBetweenTurns = true;
             nextBrogueEvent(&theEvent, false, true, false);
@@ -991,6 +1107,7 @@ void mainBrogueJunction()
             executeEvent(&theEvent);
           }
 
+          freePlaybackKeyframes();
           freeEverything();
         }
         else
@@ -1007,7 +1124,7 @@ void mainBrogueJunction()
         break;
       case NG_SCUM:
         rogue.nextGame = NG_NOTHING;
-        scum(1, 1000, 5);
+        scum(1, 1000, 5, 1);
         break;
       case NG_QUIT:
         // No need to do anything.
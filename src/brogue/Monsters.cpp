@@ -858,6 +858,7 @@ bool drawManacle(int x, int y, enum Directions dir)
       pmap[newX][newY].layers[LIQUID] == NOTHING)
   {
     pmap[x + nbDirs[dir][0]][y + nbDirs[dir][1]].layers[SURFACE] = manacles[dir];
+    updateTerrainFlags(newX, newY);
     return true;
   }
   return false;
@@ -885,7 +886,7 @@ Creature* spawnHorde(int hordeID, int x, int y, unsigned long forbiddenFlags, un
   int i, failsafe, depth;
   HordeType* theHorde;
   Creature *leader, *preexistingMonst;
-  bool tryAgain;
+  bool tryAgain, cachedTerrainFlags;
 
   if (rogue.depthLevel > 1 && rand_percent(10))
   {
@@ -973,8 +974,15 @@ Creature* spawnHorde(int hordeID, int x, int y, unsigned long forbiddenFlags, un
 
   if (theHorde->machine > 0)
   {
-    // Build the accompanying machine (e.g. a goblin encampment)
+    // Build the accompanying machine (e.g. a goblin encampment). Machines are built with the level
+    // generator, which doesn't keep the terrain flag cache, so catch it up afterwards.
+    cachedTerrainFlags = terrainFlagCache.valid;
+    invalidateTerrainFlags();
     buildAMachine(theHorde->machine, x, y, 0, nullptr, nullptr, nullptr);
+    if (cachedTerrainFlags)
+    {
+      rebuildTerrainFlags();
+    }
   }
 
   leader = generateMonster(theHorde->leaderType, true, true);
@@ -4173,6 +4181,7 @@ bool moveMonster(Creature* monst, int dx, int dy)
     else if (tileCatalog[pmap[x][y].layers[SURFACE]].flags & T_ENTANGLES)
     {
       pmap[x][y].layers[SURFACE] = NOTHING;
+      updateTerrainFlags(x, y);
     }
   }
 
@@ -25,6 +25,7 @@
 #include "IncludeGlobals.h"
 #include "Rogue.h"
 #include "Movement.h"
+#include "Grid.h"
 
 void playerRuns(int direction)
 {
@@ -932,6 +933,7 @@ bool playerMoves(int direction)
       if (tileCatalog[pmap[x][y].layers[SURFACE]].flags & T_ENTANGLES)
       {
         pmap[x][y].layers[SURFACE] = NOTHING;
+        updateTerrainFlags(x, y);
       }
     }
   }
@@ -1802,27 +1804,9 @@ void travel(int x, int y, bool autoConfirm)
 
 void populateGenericCostMap(int** costMap)
 {
-  int i, j;
+  const CostMapProfile profile = { GENERIC_COST_MAP, 0, false, false };
 
-  for (i = 0; i < DCOLS; i++)
-  {
-    for (j = 0; j < DROWS; j++)
-    {
-      if (cellHasTerrainFlag(i, j, T_OBSTRUCTS_PASSABILITY) &&
-          (!cellHasTMFlag(i, j, TM_IS_SECRET) || (discoveredTerrainFlagsAtLoc(i, j) & T_OBSTRUCTS_PASSABILITY)))
-      {
-        costMap[i][j] = cellHasTerrainFlag(i, j, T_OBSTRUCTS_DIAGONAL_MOVEMENT) ? PDS_OBSTRUCTION : PDS_FORBIDDEN;
-      }
-      else if (cellHasTerrainFlag(i, j, T_PATHING_BLOCKER & ~T_OBSTRUCTS_PASSABILITY))
-      {
-        costMap[i][j] = PDS_FORBIDDEN;
-      }
-      else
-      {
-        costMap[i][j] = 1;
-      }
-    }
-  }
+  copyGrid(costMap, cachedCostMap(&profile));
 }
 
 void getLocationFlags(const int x, const int y, unsigned long* tFlags, unsigned long* TMFlags,
@@ -2297,6 +2281,7 @@ void discover(int x, int y)
       {
         feat = &dungeonFeatureCatalog[tileCatalog[pmap[x][y].layers[layer]].discoverType];
         pmap[x][y].layers[layer] = (layer == DUNGEON ? FLOOR : NOTHING);
+        updateTerrainFlags(x, y);
         spawnDungeonFeature(x, y, feat, true, false);
       }
     }
@@ -2625,36 +2610,71 @@ void betweenOctant1andN(int* x, int* y, int x0, int y0, int n)
   }
 }
 
-// Returns a bool grid indicating whether each square is in the field of view of (xLoc, yLoc).
-// forbiddenTerrain is the set of terrain flags that will block vision (but the blocking cell itself is
-// illuminated); forbiddenFlags is the set of map flags that will block vision.
-// If cautiousOnWalls is set, we will not illuminate blocking tiles unless the tile one space closer to the origin
-// is visible to the player; this is to prevent lights from illuminating a wall when the player is on the other
-// side of the wall.
-void getFOVMask(char grid[DCOLS][DROWS], int xLoc, int yLoc, float maxRadius, unsigned long forbiddenTerrain,
-                unsigned long forbiddenFlags, bool cautiousOnWalls)
+// betweenOctant1andN() as coefficients: in octant n, the cell columnsRightFromOrigin = c over and i along
+// from (xLoc, yLoc) is (xLoc + t[0] * c + t[1] * i, yLoc + t[2] * c + t[3] * i), t = octantTransforms[n].
+static const int octantTransforms[9][4] = {
+    {0, 0, 0, 0},   {1, 0, 0, 1},  {1, 0, 0, -1}, {0, -1, 1, 0},  {0, 1, 1, 0},
+    {-1, 0, 0, -1}, {-1, 0, 0, 1}, {0, 1, -1, 0}, {0, -1, -1, 0},
+};
+
+// The slopes at which a column's run of clear cells starts and ends, by column and by how far along
+// (i is never positive, so they're indexed by -i). Only cells on the map start or end a run, and no cell
+// on the map is DCOLS or more columns out, so that bounds the tables.
+struct FOVSlopeTables
 {
-  int i;
+  long startSlopes[DCOLS][DCOLS];
+  long endSlopes[DCOLS][DCOLS];
+};
 
-  for (i = 1; i <= 8; i++)
-  {
-    scanOctantFOV(grid, xLoc, yLoc, i, maxRadius, 1, LOS_SLOPE_GRANULARITY * -1, 0, forbiddenTerrain, forbiddenFlags,
-                  cautiousOnWalls);
-  }
+static const FOVSlopeTables& fovSlopeTables()
+{
+  static const FOVSlopeTables* tables = []() {
+    FOVSlopeTables* t = new FOVSlopeTables;
+    int column, i;
+
+    for (column = 1; column < DCOLS; column++)
+    {
+      for (i = 0; i >= -column; i--)
+      {
+        t->startSlopes[column][-i] =
+            (long int)((LOS_SLOPE_GRANULARITY * (i)-LOS_SLOPE_GRANULARITY / 2) / (column + 0.5));
+        t->endSlopes[column][-i] =
+            (long int)((LOS_SLOPE_GRANULARITY * (i)-LOS_SLOPE_GRANULARITY / 2) / (column - 0.5));
+      }
+    }
+    return t;
+  }();
+  return *tables;
 }
 
+// What one getFOVMask() call scans against: which cells block, the octant being scanned, and where the
+// circle of maxRadius cuts each column.
+struct FOVScan
+{
+  char (*grid)[DROWS];
+  int xLoc, yLoc;
+  float maxRadius;
+  bool cautiousOnWalls;
+  std::vector<FOVWallCell>* walls;  // if set, cautious walls are listed here instead of being decided
+  CellSet* tested;                  // if set, every cell whose blocking was looked at is added here
+  const int* transform;
+  CellSet obstructed, inFieldOfView;  // inFieldOfView is only filled in if it's needed
+  int circleStarts[DCOLS + 1];
+};
+
 // This is a custom implementation of recursive shadowcasting.
-void scanOctantFOV(char grid[DCOLS][DROWS], int xLoc, int yLoc, int octant, float maxRadius,
-                   int columnsRightFromOrigin, long startSlope, long endSlope, unsigned long forbiddenTerrain,
-                   unsigned long forbiddenFlags, bool cautiousOnWalls)
+static void scanOctantFOV(FOVScan* scan, int columnsRightFromOrigin, long startSlope, long endSlope)
 {
+  const FOVSlopeTables& slopes = fovSlopeTables();
+  const int* t = scan->transform;
+  const float maxRadius = scan->maxRadius;
+  int i, a, b, iStart, iEnd, x, y, x2, y2, i2;
+  long newStartSlope, newEndSlope;
+  bool cellObstructed, currentlyLit;
+
   if (columnsRightFromOrigin >= maxRadius)
     return;
 
-  int i, a, b, iStart, iEnd, x, y, x2, y2;  // x and y are temporary variables on which we do the octant transform
-  long newStartSlope, newEndSlope;
-  bool cellObstructed;
-
   newStartSlope = startSlope;
 
   a = ((LOS_SLOPE_GRANULARITY / -2 + 1) + startSlope * columnsRightFromOrigin) / LOS_SLOPE_GRANULARITY;
@@ -2670,67 +2690,59 @@ void scanOctantFOV(char grid[DCOLS][DROWS], int xLoc, int yLoc, int octant, floa
   }
   if ((columnsRightFromOrigin * columnsRightFromOrigin + iStart * iStart) >= maxRadius * maxRadius)
   {
-    iStart = (int)(-1 * sqrt(maxRadius * maxRadius - columnsRightFromOrigin * columnsRightFromOrigin) + FLOAT_FUDGE);
+    iStart = scan->circleStarts[columnsRightFromOrigin];
   }
 
-  x = xLoc + columnsRightFromOrigin;
-  y = yLoc + iStart;
-  betweenOctant1andN(&x, &y, xLoc, yLoc, octant);
-  bool currentlyLit =
-      coordinatesAreInMap(x, y) && !(cellHasTerrainFlag(x, y, forbiddenTerrain) || (pmap[x][y].flags & forbiddenFlags));
-  for (i = iStart; i <= iEnd; i++)
+  x = scan->xLoc + t[0] * columnsRightFromOrigin + t[1] * iStart;
+  y = scan->yLoc + t[2] * columnsRightFromOrigin + t[3] * iStart;
+  currentlyLit = coordinatesAreInMap(x, y) && !scan->obstructed.contains(x, y);
+  for (i = iStart; i <= iEnd; i++, x += t[1], y += t[3])
   {
-    x = xLoc + columnsRightFromOrigin;
-    y = yLoc + i;
-    betweenOctant1andN(&x, &y, xLoc, yLoc, octant);
     if (!coordinatesAreInMap(x, y))
     {
       // We're off the map -- here there be memory corruption.
       continue;
     }
-    cellObstructed = (cellHasTerrainFlag(x, y, forbiddenTerrain) || (pmap[x][y].flags & forbiddenFlags));
+    cellObstructed = scan->obstructed.contains(x, y);
+    if (scan->tested)
+    {
+      scan->tested->add(x, y);
+    }
     // if we're cautious on walls and this is a wall:
-    if (cautiousOnWalls && cellObstructed)
+    if (scan->cautiousOnWalls && cellObstructed)
     {
       // (x2, y2) is the tile one space closer to the origin from the tile we're on:
-      x2 = xLoc + columnsRightFromOrigin - 1;
-      y2 = yLoc + i;
-      if (i < 0)
+      i2 = (i < 0 ? i + 1 : i > 0 ? i - 1 : i);
+      x2 = scan->xLoc + t[0] * (columnsRightFromOrigin - 1) + t[1] * i2;
+      y2 = scan->yLoc + t[2] * (columnsRightFromOrigin - 1) + t[3] * i2;
+
+      if (scan->walls)
       {
-        y2++;
+        scan->walls->push_back({x, y, x2, y2});
       }
-      else if (i > 0)
-      {
-        y2--;
-      }
-      betweenOctant1andN(&x2, &y2, xLoc, yLoc, octant);
-
-      if (pmap[x2][y2].flags & IN_FIELD_OF_VIEW)
+      else if (scan->inFieldOfView.contains(x2, y2))
       {
         // previous tile is visible, so illuminate
-        grid[x][y] = 1;
+        scan->grid[x][y] = 1;
       }
     }
     else
     {
       // illuminate
-      grid[x][y] = 1;
+      scan->grid[x][y] = 1;
     }
     if (!cellObstructed && !currentlyLit)
     {  // next column slope starts here
-      newStartSlope =
-          (long int)((LOS_SLOPE_GRANULARITY * (i)-LOS_SLOPE_GRANULARITY / 2) / (columnsRightFromOrigin + 0.5));
+      newStartSlope = slopes.startSlopes[columnsRightFromOrigin][-i];
       currentlyLit = true;
     }
     else if (cellObstructed && currentlyLit)
     {  // next column slope ends here
-      newEndSlope =
-          (long int)((LOS_SLOPE_GRANULARITY * (i)-LOS_SLOPE_GRANULARITY / 2) / (columnsRightFromOrigin - 0.5));
+      newEndSlope = slopes.endSlopes[columnsRightFromOrigin][-i];
       if (newStartSlope <= newEndSlope)
       {
         // run next column
-        scanOctantFOV(grid, xLoc, yLoc, octant, maxRadius, columnsRightFromOrigin + 1, newStartSlope, newEndSlope,
-                      forbiddenTerrain, forbiddenFlags, cautiousOnWalls);
+        scanOctantFOV(scan, columnsRightFromOrigin + 1, newStartSlope, newEndSlope);
       }
       currentlyLit = false;
     }
@@ -2741,12 +2753,130 @@ void scanOctantFOV(char grid[DCOLS][DROWS], int xLoc, int yLoc, int octant, floa
     if (newStartSlope <= newEndSlope)
     {
       // run next column
-      scanOctantFOV(grid, xLoc, yLoc, octant, maxRadius, columnsRightFromOrigin + 1, newStartSlope, newEndSlope,
-                    forbiddenTerrain, forbiddenFlags, cautiousOnWalls);
+      scanOctantFOV(scan, columnsRightFromOrigin + 1, newStartSlope, newEndSlope);
+    }
+  }
+}
+
+// Works out which cells block the scan, for the box of cells within maxRadius, rather than cell by cell
+// in each octant. Columns outside the box, and rows outside it, are left clear.
+static void findFOVBlockers(FOVScan* scan, unsigned long forbiddenTerrain, unsigned long forbiddenFlags,
+                            const CellSet* flaggedCells, bool findFieldOfView)
+{
+  const int radius = (int)scan->maxRadius;
+  unsigned long rowMask;
+  int i, j, left, right, top, bottom;
+
+  left = max(0, scan->xLoc - radius);
+  right = min(DCOLS - 1, scan->xLoc + radius);
+  top = max(0, scan->yLoc - radius);
+  bottom = min(DROWS - 1, scan->yLoc + radius);
+  rowMask = ((1UL << (bottom + 1)) - 1) & ~((1UL << top) - 1);
+
+  scan->obstructed.clear();
+  getTerrainFlagCellSet(&scan->obstructed, forbiddenTerrain, left, right);
+  for (i = left; i <= right; i++)
+  {
+    if (flaggedCells)
+    {
+      scan->obstructed.columns[i] |= flaggedCells->columns[i];
     }
+    scan->obstructed.columns[i] &= rowMask;
+  }
+  if ((forbiddenFlags && !flaggedCells) || findFieldOfView)
+  {
+    scan->inFieldOfView.clear();
+    for (i = left; i <= right; i++)
+    {
+      for (j = top; j <= bottom; j++)
+      {
+        if (!flaggedCells && (pmap[i][j].flags & forbiddenFlags))
+        {
+          scan->obstructed.add(i, j);
+        }
+        if (pmap[i][j].flags & IN_FIELD_OF_VIEW)
+        {
+          scan->inFieldOfView.add(i, j);
+        }
+      }
+    }
+  }
+}
+
+static void runFOVScan(FOVScan* scan)
+{
+  int i, column;
+
+  for (column = 1; column <= DCOLS && column < scan->maxRadius; column++)
+  {
+    scan->circleStarts[column] =
+        (int)(-1 * sqrt(scan->maxRadius * scan->maxRadius - column * column) + FLOAT_FUDGE);
+  }
+
+  for (i = 1; i <= 8; i++)
+  {
+    scan->transform = octantTransforms[i];
+    scanOctantFOV(scan, 1, LOS_SLOPE_GRANULARITY * -1, 0);
   }
 }
 
+// Returns a bool grid indicating whether each square is in the field of view of (xLoc, yLoc).
+// forbiddenTerrain is the set of terrain flags that will block vision (but the blocking cell itself is
+// illuminated); forbiddenFlags is the set of map flags that will block vision.
+// If cautiousOnWalls is set, we will not illuminate blocking tiles unless the tile one space closer to the origin
+// is visible to the player; this is to prevent lights from illuminating a wall when the player is on the other
+// side of the wall.
+void getFOVMask(char grid[DCOLS][DROWS], int xLoc, int yLoc, float maxRadius, unsigned long forbiddenTerrain,
+                unsigned long forbiddenFlags, bool cautiousOnWalls)
+{
+  FOVScan scan;
+
+  scan.grid = grid;
+  scan.xLoc = xLoc;
+  scan.yLoc = yLoc;
+  scan.maxRadius = maxRadius;
+  scan.cautiousOnWalls = cautiousOnWalls;
+  scan.walls = nullptr;
+  scan.tested = nullptr;
+  findFOVBlockers(&scan, forbiddenTerrain, forbiddenFlags, nullptr, cautiousOnWalls);
+  runFOVScan(&scan);
+}
+
+// The cells that would block getFOVMask() from (xLoc, yLoc): everything it reads of the map besides
+// IN_FIELD_OF_VIEW, so two scans with the same blockers come out the same. flaggedCells, if the caller
+// has it, is every cell with any of forbiddenFlags, and saves looking them up.
+void getFOVBlockers(CellSet* blockers, int xLoc, int yLoc, float maxRadius, unsigned long forbiddenTerrain,
+                    unsigned long forbiddenFlags, const CellSet* flaggedCells)
+{
+  FOVScan scan;
+
+  scan.xLoc = xLoc;
+  scan.yLoc = yLoc;
+  scan.maxRadius = maxRadius;
+  findFOVBlockers(&scan, forbiddenTerrain, forbiddenFlags, (forbiddenFlags ? flaggedCells : nullptr), false);
+  *blockers = scan.obstructed;
+}
+
+// getFOVMask() with cautiousOnWalls, against blockers from getFOVBlockers(). The walls it would light only
+// if the cell in front of them is in the field of view are added to walls instead, and left out of grid.
+// The cells whose blocking the scan looked at are added to tested: the scan comes out the same for any
+// blockers that agree on those.
+void getCautiousFOVMask(char grid[DCOLS][DROWS], int xLoc, int yLoc, float maxRadius, const CellSet* blockers,
+                        std::vector<FOVWallCell>* walls, CellSet* tested)
+{
+  FOVScan scan;
+
+  scan.grid = grid;
+  scan.xLoc = xLoc;
+  scan.yLoc = yLoc;
+  scan.maxRadius = maxRadius;
+  scan.cautiousOnWalls = true;
+  scan.walls = walls;
+  scan.tested = tested;
+  scan.obstructed = *blockers;
+  runFOVScan(&scan);
+}
+
 void addScentToCell(int x, int y, int distance)
 {
   unsigned int value;
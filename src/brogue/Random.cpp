@@ -102,7 +102,32 @@ typedef struct ranctx
   u4 d;
 } ranctx;
 
-static ranctx RNGState[2];
+static thread_local ranctx RNGState[NUMBER_OF_RNGS];  // per game, like the rest of the game state
+
+// Copies the state of every RNG out to state, four words per RNG, for game snapshots.
+void getRNGState(unsigned long state[RNG_STATE_WORDS])
+{
+  int i;
+  for (i = 0; i < NUMBER_OF_RNGS; i++)
+  {
+    state[4 * i] = RNGState[i].a;
+    state[4 * i + 1] = RNGState[i].b;
+    state[4 * i + 2] = RNGState[i].c;
+    state[4 * i + 3] = RNGState[i].d;
+  }
+}
+
+void setRNGState(const unsigned long state[RNG_STATE_WORDS])
+{
+  int i;
+  for (i = 0; i < NUMBER_OF_RNGS; i++)
+  {
+    RNGState[i].a = (u4)state[4 * i];
+    RNGState[i].b = (u4)state[4 * i + 1];
+    RNGState[i].c = (u4)state[4 * i + 2];
+    RNGState[i].d = (u4)state[4 * i + 3];
+  }
+}
 
 #define rot(x, k) (((x) << (k)) | ((x) >> (32 - (k))))
 u4 ranval(ranctx* x)
@@ -23,10 +23,20 @@
 #include <limits.h>
 #include <math.h>
 #include <time.h>
+#include <atomic>
+#include <chrono>
 #include "IncludeGlobals.h"
 #include "Rogue.h"
+#include "Snapshot.h"
 
 #define RECORDING_HEADER_LENGTH 32  // bytes at the start of the recording file to store global data
+#define PLAYBACK_KEYFRAME_INTERVAL 100  // turns between keyframes, to begin with
+#define PLAYBACK_KEYFRAME_LIMIT 32      // past this, every other keyframe is dropped and the interval doubles
+
+// Snapshots taken while a recording plays, so that seeking replays from the nearest one.
+static thread_local GameSnapshot playbackKeyframes[PLAYBACK_KEYFRAME_LIMIT];
+static thread_local int playbackKeyframeCount = 0;
+static thread_local unsigned long playbackKeyframeInterval = PLAYBACK_KEYFRAME_INTERVAL;
 
 #pragma mark Recording functions
 
@@ -186,11 +196,49 @@ void recordMouseClick(int x, int y, bool controlKey, bool shiftKey)
   recordEvent(&theEvent);
 }
 
-void writeHeaderInfo(char* path)
+// The recording stays open from one buffer's worth of reading or writing to the next, instead of being
+// reopened every time. Anything that renames, removes or replaces the file closes it first.
+static thread_local FILE* recordingFile = nullptr;
+static thread_local char recordingFilePath[BROGUE_FILENAME_MAX];
+static thread_local bool recordingFileWritable = false;
+
+static FILE* openRecordingFile()
+{
+  bool writable = !rogue.playbackMode;
+
+  if (recordingFile && (writable != recordingFileWritable || strcmp(recordingFilePath, currentFilePath)))
+  {
+    closeRecordingFile();
+  }
+  if (recordingFile == nullptr)
+  {
+    recordingFile = fopen(currentFilePath, writable ? "r+b" : "rb");
+    if (recordingFile == nullptr && writable)
+    {
+      recordingFile = fopen(currentFilePath, "w+b");
+    }
+    if (recordingFile)
+    {
+      strcpy(recordingFilePath, currentFilePath);
+      recordingFileWritable = writable;
+    }
+  }
+  return recordingFile;
+}
+
+void closeRecordingFile()
+{
+  if (recordingFile)
+  {
+    fclose(recordingFile);
+    recordingFile = nullptr;
+  }
+}
+
+static void writeHeaderInfo(FILE* recordFile)
 {
   unsigned char c[RECORDING_HEADER_LENGTH];
   int i;
-  FILE* recordFile;
 
   // Zero out the entire header to start.
   for (i = 0; i < RECORDING_HEADER_LENGTH; i++)
@@ -213,25 +261,8 @@ void writeHeaderInfo(char* path)
   numberToString(lengthOfPlaybackFile, 4, &c[i]);
   i += 4;
 
-  if (!fileExists(path))
-  {
-    recordFile = fopen(path, "wb");
-    if (recordFile)
-    {
-      fclose(recordFile);
-    }
-  }
-
-  recordFile = fopen(path, "r+b");
-  rewind(recordFile);
-  for (i = 0; i < RECORDING_HEADER_LENGTH; i++)
-  {
-    putc(c[i], recordFile);
-  }
-  if (recordFile)
-  {
-    fclose(recordFile);
-  }
+  fseek(recordFile, 0, SEEK_SET);
+  fwrite(c, 1, RECORDING_HEADER_LENGTH, recordFile);
 
   if (lengthOfPlaybackFile < RECORDING_HEADER_LENGTH)
   {
@@ -241,7 +272,6 @@ void writeHeaderInfo(char* path)
 
 void flushBufferToFile()
 {
-  int i;
   FILE* recordFile;
 
   if (rogue.playbackMode)
@@ -249,41 +279,36 @@ void flushBufferToFile()
     return;
   }
 
+  recordFile = openRecordingFile();
+  if (recordFile == nullptr)
+  {
+    return;
+  }
+
   lengthOfPlaybackFile += locationInRecordingBuffer;
-  writeHeaderInfo(currentFilePath);
+  writeHeaderInfo(recordFile);
 
   if (locationInRecordingBuffer != 0)
   {
-    recordFile = fopen(currentFilePath, "ab");
-
-    for (i = 0; i < locationInRecordingBuffer; i++)
-    {
-      putc(inputRecordBuffer[i], recordFile);
-    }
-
-    if (recordFile)
-    {
-      fclose(recordFile);
-    }
-
+    fseek(recordFile, 0, SEEK_END);
+    fwrite(inputRecordBuffer, 1, locationInRecordingBuffer, recordFile);
     locationInRecordingBuffer = 0;
   }
+  fflush(recordFile);  // so the file on disk is a complete recording, should we crash
 }
 
 #pragma mark Playback functions
 
 void fillBufferFromFile()
 {
-  //	int i;
   FILE* recordFile;
 
-  recordFile = fopen(currentFilePath, "rb");
-  fseek(recordFile, positionInPlaybackFile, SEEK_SET);
-
-  fread((void*)inputRecordBuffer, 1, INPUT_RECORD_BUFFER, recordFile);
-
-  positionInPlaybackFile = ftell(recordFile);
-  fclose(recordFile);
+  recordFile = openRecordingFile();
+  if (recordFile)
+  {
+    fseek(recordFile, positionInPlaybackFile, SEEK_SET);
+    positionInPlaybackFile += fread((void*)inputRecordBuffer, 1, PLAYBACK_READ_BUFFER, recordFile);
+  }
 
   locationInRecordingBuffer = 0;
 }
@@ -297,7 +322,7 @@ unsigned char recallChar()
   }
   c = inputRecordBuffer[locationInRecordingBuffer++];
   recordingLocation++;
-  if (locationInRecordingBuffer >= INPUT_RECORD_BUFFER)
+  if (locationInRecordingBuffer >= PLAYBACK_READ_BUFFER)
   {
     fillBufferFromFile();
   }
@@ -343,6 +368,14 @@ void playbackPanic()
 {
   cellDisplayBuffer rbuf[COLS][ROWS];
 
+  if (rogue.playbackHeadless)
+  {
+    // Nobody to show the apology to, and nothing to wait for; stop where the divergence happened.
+    rogue.playbackOOS = true;
+    rogue.gameHasEnded = true;
+    return;
+  }
+
   if (!rogue.playbackOOS)
   {
     rogue.playbackFastForward = false;
@@ -524,6 +557,7 @@ void initRecording()
   positionInPlaybackFile = 0;
   recordingLocation = 0;
   maxLevelChanges = 0;
+  freePlaybackKeyframes();
   rogue.playbackOOS = false;
   rogue.playbackOmniscience = false;
   rogue.nextAnnotationTurn = 0;
@@ -544,7 +578,11 @@ void initRecording()
       versionString[i] = recallChar();
     }
 
-    if (strcmp(versionString, BROGUE_VERSION_STRING))
+    if (strcmp(versionString, BROGUE_VERSION_STRING) && rogue.playbackHeadless)
+    {
+      rogue.gameHasEnded = true;
+    }
+    else if (strcmp(versionString, BROGUE_VERSION_STRING))
     {
       rogue.playbackMode = false;
       rogue.playbackFastForward = false;
@@ -576,6 +614,7 @@ void initRecording()
   else
   {
     lengthOfPlaybackFile = 1;
+    closeRecordingFile();
     remove(currentFilePath);
     recordFile = fopen(currentFilePath, "wb");  // create the file
     fclose(recordFile);
@@ -710,6 +749,85 @@ void printPlaybackHelpScreen()
   overlayDisplayBuffer(rbuf, nullptr);
 }
 
+void freePlaybackKeyframes()
+{
+  int i;
+
+  for (i = 0; i < playbackKeyframeCount; i++)
+  {
+    freeGameSnapshot(&playbackKeyframes[i]);
+  }
+  playbackKeyframeCount = 0;
+  playbackKeyframeInterval = PLAYBACK_KEYFRAME_INTERVAL;
+}
+
+// Called between events by the playback loops, where nothing of the game lives on the stack.
+void considerCapturingPlaybackKeyframe()
+{
+  int i;
+
+  if (!rogue.playbackMode || rogue.playbackOOS || rogue.gameHasEnded ||
+      (playbackKeyframeCount > 0 &&
+       rogue.playerTurnNumber < playbackKeyframes[playbackKeyframeCount - 1].playerTurnNumber + playbackKeyframeInterval))
+  {
+    return;
+  }
+
+  if (playbackKeyframeCount == PLAYBACK_KEYFRAME_LIMIT)
+  {
+    for (i = 0; i < PLAYBACK_KEYFRAME_LIMIT; i++)
+    {
+      if (i % 2)
+      {
+        freeGameSnapshot(&playbackKeyframes[i]);
+      }
+      else
+      {
+        playbackKeyframes[i / 2] = playbackKeyframes[i];
+      }
+    }
+    memset(&playbackKeyframes[PLAYBACK_KEYFRAME_LIMIT / 2], 0, sizeof(GameSnapshot) * (PLAYBACK_KEYFRAME_LIMIT / 2));
+    playbackKeyframeCount = PLAYBACK_KEYFRAME_LIMIT / 2;
+    playbackKeyframeInterval *= 2;
+  }
+
+  captureGameSnapshot(&playbackKeyframes[playbackKeyframeCount++]);
+}
+
+// Jumps to the last keyframe at or before the destination, if that gets us closer to it than we
+// are now. Returns false if there was no such keyframe.
+static bool restorePlaybackKeyframe(unsigned long destinationFrame)
+{
+  int i;
+
+  for (i = playbackKeyframeCount - 1; i >= 0 && playbackKeyframes[i].playerTurnNumber > destinationFrame; i--)
+    ;
+  if (i < 0 ||
+      (destinationFrame >= rogue.playerTurnNumber && playbackKeyframes[i].playerTurnNumber <= rogue.playerTurnNumber) ||
+      !restoreGameSnapshot(&playbackKeyframes[i]))
+  {
+    return false;
+  }
+  updateColors();  // the keyframe can be on another depth
+
+  // Pick up reading the recording where the keyframe left off.
+  positionInPlaybackFile = recordingLocation;
+  fillBufferFromFile();
+  rogue.playbackOOS = false;
+
+  rogue.nextAnnotationTurn = 0;
+  rogue.locationInAnnotationFile = 0;
+  if (fileExists(annotationPathname))
+  {
+    loadNextAnnotation();
+  }
+  else
+  {
+    rogue.nextAnnotationTurn = -1;
+  }
+  return true;
+}
+
 void advanceToLocation(unsigned long destinationFrame)
 {
   unsigned long progressBarInterval, initialFrameNumber;
@@ -725,7 +843,15 @@ void advanceToLocation(unsigned long destinationFrame)
 
   cellDisplayBuffer dbuf[COLS][ROWS];
 
-  if (destinationFrame < rogue.playerTurnNumber)
+  if (restorePlaybackKeyframe(destinationFrame))
+  {
+    useProgressBar = (destinationFrame - rogue.playerTurnNumber > 100 ? true : false);
+    if (useProgressBar)
+    {
+      blackOutScreen();
+    }
+  }
+  else if (destinationFrame < rogue.playerTurnNumber)
   {
     useProgressBar = (destinationFrame > 100 ? true : false);
 
@@ -766,6 +892,7 @@ void advanceToLocation(unsigned long destinationFrame)
       pauseBrogue(1);
     }
 
+    considerCapturingPlaybackKeyframe();
     rogue.RNG = RNG_COSMETIC;  // dancing terrain colors can't influence recordings
     rogue.playbackDelayThisTurn = 0;
     nextBrogueEvent(&theEvent, false, true, false);
@@ -918,6 +1045,7 @@ void executePlaybackInput(RogueEvent* recordingInput)
             rogue.playbackFastForward = true;
             while ((rogue.deepestLevel <= previousDeepestLevel || !rogue.playbackBetweenTurns) && !rogue.gameHasEnded)
             {
+              considerCapturingPlaybackKeyframe();
               rogue.RNG = RNG_COSMETIC;  // dancing terrain colors can't influence recordings
               nextBrogueEvent(&theEvent, false, true, false);
               rogue.RNG = RNG_SUBSTANTIVE;
@@ -1001,6 +1129,7 @@ void executePlaybackInput(RogueEvent* recordingInput)
           {
             while (rogue.playerTurnNumber < destinationFrame && !rogue.gameHasEnded && !rogue.playbackOOS)
             {
+              considerCapturingPlaybackKeyframe();
               rogue.RNG = RNG_COSMETIC;  // dancing terrain colors can't influence recordings
               rogue.playbackDelayThisTurn = 0;
               nextBrogueEvent(&theEvent, false, true, false);
@@ -1180,9 +1309,37 @@ bool characterForbiddenInFilename(const char theChar)
   }
 }
 
+// The snapshot that goes with a saved game sits beside it, under the same name.
+static void snapshotPathForGame(char* snapshotPath, const char* gamePath)
+{
+  size_t length = strlen(gamePath);
+
+  strcpy(snapshotPath, gamePath);
+  if (length >= strlen(GAME_SUFFIX) && !strcmp(&snapshotPath[length - strlen(GAME_SUFFIX)], GAME_SUFFIX))
+  {
+    snapshotPath[length - strlen(GAME_SUFFIX)] = '\0';
+  }
+  strcat(snapshotPath, SNAPSHOT_SUFFIX);
+}
+
+// Lets loadSavedGame() skip the replay. The recording is still saved in full, so the game loads the
+// slow way if the snapshot is missing or was written by a different build.
+static void saveGameSnapshot(const char* gamePath)
+{
+  char snapshotPath[BROGUE_FILENAME_MAX + sizeof(SNAPSHOT_SUFFIX)];
+  GameSnapshot snapshot;
+
+  memset(&snapshot, 0, sizeof(snapshot));
+  snapshotPathForGame(snapshotPath, gamePath);
+  captureGameSnapshot(&snapshot);
+  writeGameSnapshot(&snapshot, snapshotPath);
+  freeGameSnapshot(&snapshot);
+}
+
 void saveGame()
 {
   char filePath[BROGUE_FILENAME_MAX], defaultPath[BROGUE_FILENAME_MAX];
+  char snapshotPath[BROGUE_FILENAME_MAX + sizeof(SNAPSHOT_SUFFIX)];
   bool askAgain;
 
   if (rogue.playbackMode)
@@ -1203,9 +1360,13 @@ void saveGame()
       if (!fileExists(filePath) || confirm("File of that name already exists. Overwrite?", true))
       {
         remove(filePath);
+        snapshotPathForGame(snapshotPath, filePath);
+        remove(snapshotPath);
         flushBufferToFile();
+        closeRecordingFile();
         rename(currentFilePath, filePath);
         strcpy(currentFilePath, filePath);
+        saveGameSnapshot(filePath);
         message("Saved.", true);
         rogue.gameHasEnded = true;
       }
@@ -1229,6 +1390,7 @@ void saveRecording()
   }
 
   getAvailableFilePath(defaultPath, "Recording", RECORDING_SUFFIX);
+  closeRecordingFile();
 
   deleteMessages();
   do
@@ -1289,6 +1451,9 @@ void copyFile(char* fromFilePath, char* toFilePath, unsigned long fromFileLength
 void switchToPlaying()
 {
   char lastGamePath[BROGUE_FILENAME_MAX];
+#ifdef DELETE_SAVE_FILE_AFTER_LOADING
+  char snapshotPath[BROGUE_FILENAME_MAX + sizeof(SNAPSHOT_SUFFIX)];
+#endif
 
   getAvailableFilePath(lastGamePath, LAST_GAME_NAME, GAME_SUFFIX);
   strcat(lastGamePath, GAME_SUFFIX);
@@ -1297,10 +1462,13 @@ void switchToPlaying()
   rogue.playbackFastForward = false;
   rogue.playbackOmniscience = false;
   locationInRecordingBuffer = 0;
+  closeRecordingFile();
   copyFile(currentFilePath, lastGamePath, recordingLocation);
 
 #ifdef DELETE_SAVE_FILE_AFTER_LOADING
   remove(currentFilePath);
+  snapshotPathForGame(snapshotPath, currentFilePath);
+  remove(snapshotPath);
 #endif
 
   strcpy(currentFilePath, lastGamePath);
@@ -1311,6 +1479,29 @@ void switchToPlaying()
   displayLevel();
 }
 
+// Restores the saved game from its snapshot, if it has one that matches the recording header
+// that initializeRogue() just read. Returns false, with the game as it was, otherwise.
+static bool restoreSavedGameSnapshot()
+{
+  char snapshotPath[BROGUE_FILENAME_MAX + sizeof(SNAPSHOT_SUFFIX)];
+  GameSnapshot snapshot;
+  bool restored = false;
+
+  memset(&snapshot, 0, sizeof(snapshot));
+  snapshotPathForGame(snapshotPath, currentFilePath);
+  if (readGameSnapshot(&snapshot, snapshotPath) && snapshot.seed == rogue.seed &&
+      snapshot.playerTurnNumber == rogue.howManyTurns && snapshot.recordingLocation == lengthOfPlaybackFile)
+  {
+    restored = restoreGameSnapshot(&snapshot);
+  }
+  if (restored)
+  {
+    updateColors();  // startLevel() would have, for the depth we've just arrived at
+  }
+  freeGameSnapshot(&snapshot);
+  return restored;
+}
+
 void loadSavedGame()
 {
   unsigned long progressBarInterval;
@@ -1322,6 +1513,12 @@ void loadSavedGame()
   rogue.playbackMode = true;
   rogue.playbackFastForward = true;
   initializeRogue(0);  // Calls initRecording(). Seed argument is ignored because we're initially in playback mode.
+  if (!rogue.gameHasEnded && restoreSavedGameSnapshot())
+  {
+    switchToPlaying();
+    recordChar(SAVED_GAME_LOADED);
+    return;
+  }
   if (!rogue.gameHasEnded)
   {
     blackOutScreen();
@@ -1365,6 +1562,166 @@ void loadSavedGame()
   }
 }
 
+#pragma mark Batch verification
+
+enum VerifyStatus
+{
+  VERIFY_OK,
+  VERIFY_OUT_OF_SYNC,
+  VERIFY_TRUNCATED,  // played back cleanly, but stopped short of the turn count in the header
+  VERIFY_WRONG_VERSION,
+  VERIFY_UNREADABLE,
+};
+
+struct VerifyResult
+{
+  enum VerifyStatus status;
+  unsigned long recordedTurns;
+  unsigned long finalTurn;
+  unsigned long firstOOSTurn;
+  unsigned long RNGCount;
+};
+
+struct VerifyJob
+{
+  char** paths;
+  VerifyResult* results;
+  int pathCount;
+  std::atomic<int> nextPath;
+};
+
+// Replays one recording to its end, without drawing or pausing, and notes how far it got.
+static void verifyRecording(const char* path, VerifyResult* result)
+{
+  char versionString[16];
+  RogueEvent theEvent;
+  FILE* recordFile;
+
+  memset(result, 0, sizeof(VerifyResult));
+  recordFile = fopen(path, "rb");
+  if (recordFile == nullptr || fread(versionString, 1, 16, recordFile) != 16)
+  {
+    result->status = VERIFY_UNREADABLE;
+    if (recordFile)
+    {
+      fclose(recordFile);
+    }
+    return;
+  }
+  fclose(recordFile);
+  if (strncmp(versionString, BROGUE_VERSION_STRING, 16))
+  {
+    result->status = VERIFY_WRONG_VERSION;
+    return;
+  }
+
+  strcpy(currentFilePath, path);
+  annotationPathname[0] = '\0';
+  randomNumbersGenerated = 0;
+  rogue.playbackMode = true;
+  rogue.playbackFastForward = true;
+  rogue.playbackHeadless = true;
+  rogue.playbackPaused = false;
+  initializeRogue(0);  // Seed argument is ignored because we're in playback.
+  if (!rogue.gameHasEnded)
+  {
+    startLevel(rogue.depthLevel, 1);
+  }
+
+  while (!rogue.gameHasEnded && recordingLocation < lengthOfPlaybackFile)
+  {
+    rogue.RNG = RNG_COSMETIC;  // dancing terrain colors can't influence recordings
+    nextBrogueEvent(&theEvent, false, true, false);
+    rogue.RNG = RNG_SUBSTANTIVE;
+    executeEvent(&theEvent);
+  }
+
+  result->recordedTurns = rogue.howManyTurns;
+  result->finalTurn = rogue.playerTurnNumber;
+  result->RNGCount = randomNumbersGenerated;
+  if (rogue.playbackOOS)
+  {
+    result->status = VERIFY_OUT_OF_SYNC;
+    result->firstOOSTurn = rogue.playerTurnNumber;
+  }
+  else if (rogue.playerTurnNumber < rogue.howManyTurns)
+  {
+    result->status = VERIFY_TRUNCATED;
+  }
+  else
+  {
+    result->status = VERIFY_OK;
+  }
+
+  freeEverything();
+  rogue.playbackMode = false;
+  rogue.playbackOOS = false;
+}
+
+// Runs on a worker thread: takes recordings off the shared list until there are none left, so
+// that a few long games don't leave the other workers idle.
+static void verifyWorker(int workerIndex, void* data)
+{
+  VerifyJob* job = (VerifyJob*)data;
+  int i;
+
+  while ((i = job->nextPath++) < job->pathCount)
+  {
+    verifyRecording(job->paths[i], &job->results[i]);
+  }
+}
+
+// Replays every recording in paths on up to workerCount threads, then reports on each of them to
+// report, one tab-separated line per recording in the order given, and ends with a summary line.
+// Returns the number of recordings that failed to verify.
+int verifyRecordings(char** paths, int pathCount, int workerCount, FILE* report)
+{
+  const char statusNames[][12] = { "ok", "oos", "truncated", "version", "unreadable" };
+  std::chrono::steady_clock::time_point startTime;
+  unsigned long totalTurns;
+  double seconds;
+  int i, failures;
+  VerifyJob job;
+
+  job.paths = paths;
+  job.results = (VerifyResult*)calloc(max(1, pathCount), sizeof(VerifyResult));
+  job.pathCount = pathCount;
+  job.nextPath = 0;
+
+  startTime = std::chrono::steady_clock::now();
+  if (pathCount > 0)
+  {
+    runGamesInParallel(clamp(workerCount, 1, min(pathCount, MAX_VERIFY_WORKERS)), verifyWorker, &job);
+  }
+  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+  fprintf(report, "# recording\tstatus\trecorded turns\tfinal turn\tfirst OOS turn\tRNG count\n");
+  totalTurns = 0;
+  failures = 0;
+  for (i = 0; i < pathCount; i++)
+  {
+    const VerifyResult* result = &job.results[i];
+    fprintf(report, "%s\t%s\t%lu\t%lu\t", paths[i], statusNames[result->status], result->recordedTurns,
+            result->finalTurn);
+    if (result->status == VERIFY_OUT_OF_SYNC)
+    {
+      fprintf(report, "%lu", result->firstOOSTurn);
+    }
+    else
+    {
+      fprintf(report, "-");
+    }
+    fprintf(report, "\t%lu\n", result->RNGCount);
+    totalTurns += result->finalTurn;
+    failures += (result->status != VERIFY_OK);
+  }
+  fprintf(report, "# %i recordings, %i failed, %lu turns in %.2f seconds (%.0f turns per second)\n", pathCount,
+          failures, totalTurns, seconds, seconds > 0 ? totalTurns / seconds : 0.0);
+
+  free(job.results);
+  return failures;
+}
+
 #pragma mark Debug functions
 
 // the following functions are used to create human-readable descriptions of playback files for debugging purposes
@@ -27,6 +27,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
 #include "PlatformDefines.h"
 #include "Flag.h"
 #include "Types.h"
@@ -93,7 +94,12 @@
 #define RECORDING_SUFFIX ".broguerec"
 #define GAME_SUFFIX ".broguesave"
 #define ANNOTATION_SUFFIX ".txt"
+#define SNAPSHOT_SUFFIX ".broguesnap"
 #define RNG_LOG "RNGLog.txt"
+#define SEED_CATALOG_PATH "Brogue seed catalog.txt"
+
+#define MAX_SCUM_WORKERS 256  // most worker threads a seed catalog scan will start
+#define MAX_VERIFY_WORKERS 256  // most worker threads a recording verification will start
 
 #define BROGUE_FILENAME_MAX (min(1024 * 4, FILENAME_MAX))
 
@@ -153,6 +159,7 @@
 #define FALL_DAMAGE_MAX 10
 
 #define INPUT_RECORD_BUFFER 1000  // how many bytes of input data to keep in memory before saving it to disk
+#define PLAYBACK_READ_BUFFER 65536  // how many bytes of a recording to read from disk at once during playback
 #define DEFAULT_PLAYBACK_DELAY 50
 
 #define HIGH_SCORES_COUNT 30
@@ -359,6 +366,8 @@ enum RNGs
   NUMBER_OF_RNGS,
 };
 
+#define RNG_STATE_WORDS (4 * NUMBER_OF_RNGS)  // size of the state copied by getRNGState()
+
 enum DisplayDetailValues
 {
   DV_UNLIT = 0,
@@ -1089,14 +1098,23 @@ enum tileFlags
 #define max(x, y) (((x) > (y)) ? (x) : (y))
 #define clamp(x, low, hi) (min(hi, max(x, low)))  // pins x to the [y, z] interval
 
-#define terrainFlags(x, y)                                                                                             \
+#define layerTerrainFlags(x, y)                                                                                        \
   (tileCatalog[pmap[x][y].layers[DUNGEON]].flags | tileCatalog[pmap[x][y].layers[LIQUID]].flags |                      \
    tileCatalog[pmap[x][y].layers[SURFACE]].flags | tileCatalog[pmap[x][y].layers[GAS]].flags)
 
-#define terrainMechFlags(x, y)                                                                                         \
+#define layerTerrainMechFlags(x, y)                                                                                    \
   (tileCatalog[pmap[x][y].layers[DUNGEON]].mechFlags | tileCatalog[pmap[x][y].layers[LIQUID]].mechFlags |              \
    tileCatalog[pmap[x][y].layers[SURFACE]].mechFlags | tileCatalog[pmap[x][y].layers[GAS]].mechFlags)
 
+// Read from terrainFlagCache once the level is built; straight from the layers while it's being built.
+#define terrainFlags(x, y) (terrainFlagCache.valid ? terrainFlagCache.flags[x][y] : layerTerrainFlags(x, y))
+#define terrainMechFlags(x, y) (terrainFlagCache.valid ? terrainFlagCache.mechFlags[x][y] : layerTerrainMechFlags(x, y))
+
+// Column x of a terrain flag plane: bit y is set if cell (x, y) has the plane's flag. Only valid while
+// terrainFlagCache is.
+#define terrainPlaneColumn(plane, x) (terrainFlagCache.planes[(plane)][(x)])
+#define cellIsInTerrainPlane(x, y, plane) ((terrainPlaneColumn((plane), (x)) >> (y)) & 1 ? true : false)
+
 #ifdef BROGUE_ASSERTS
 bool cellHasTerrainFlag(int x, int y, unsigned long flagMask);
 #else
@@ -1224,8 +1242,56 @@ struct TCell
   int oldLight[3];  // compare with subsequent lighting to determine whether to refresh cell
 };
 
+// The terrain flags asked about whole-map at a time, kept as one bit per cell; see terrainPlaneColumn().
+enum terrainFlagPlanes
+{
+  PLANE_OBSTRUCTS_PASSABILITY,  // T_OBSTRUCTS_PASSABILITY
+  PLANE_OBSTRUCTS_VISION,       // T_OBSTRUCTS_VISION
+  PLANE_OBSTRUCTS_GAS,          // T_OBSTRUCTS_GAS
+  PLANE_PATHING_BLOCKER,        // any of T_PATHING_BLOCKER
+  PLANE_IS_FIRE,                // T_IS_FIRE
+  NUMBER_TERRAIN_FLAG_PLANES
+};
+
+// The terrain and TM flags of every cell of the current level, ORed over its layers ahead of time.
+// Every change to a layer during play goes through updateTerrainFlags(); level generation, which
+// rewrites the layers wholesale, invalidates the cache and rebuildTerrainFlags() catches up after.
+struct TerrainFlagCache
+{
+  unsigned long flags[DCOLS][DROWS];
+  unsigned long mechFlags[DCOLS][DROWS];
+  unsigned long planes[NUMBER_TERRAIN_FLAG_PLANES][DCOLS];  // a column per word, bit y for row y
+  unsigned long gasColumns[DCOLS];        // cells with a gas layer, laid out like the planes
+  unsigned long gasVolumeColumns[DCOLS];  // cells that may hold gas volume: a superset, never missing one
+  unsigned long promotableColumns[DCOLS]; // cells with a layer whose promoteChance isn't zero
+  bool valid;
+};
+
+struct CellSet;  // a bit per cell, laid out like the planes; see Grid.h
 
+// A wall that a cautious field of view lights only if (x2, y2), the cell in front of it, is in the
+// player's field of view.
+struct FOVWallCell
+{
+  int x, y, x2, y2;
+};
+
+// The kinds of cost map whose terrain part cachedCostMap() keeps.
+enum costMapKinds
+{
+  GENERIC_COST_MAP,  // populateGenericCostMap()
+  TRAVEL_COST_MAP,   // calculateDistances(), before it asks the traveler
+};
+
+struct CostMapProfile
+{
+  enum costMapKinds kind;
+  unsigned long blockingTerrainFlags;  // the rest only matter to a TRAVEL_COST_MAP
+  bool canUseSecretDoors;
+  bool discoveredOnly;  // undiscovered cells obstruct, as they do for the player
+};
 
+#define COST_UNLESS_AVOIDED 2  // in a TRAVEL_COST_MAP: costs 1, or PDS_FORBIDDEN if the traveler avoids it
 
 enum ItemFlags
 {
@@ -1770,6 +1836,7 @@ struct PlayerCharacter
   bool playbackPaused;
   bool playbackFastForward;                // for loading saved games and such -- disables drawing and prevents pauses
   bool playbackOOS;                        // playback out of sync -- no unpausing allowed
+  bool playbackHeadless;                   // nobody is watching (--verify) -- playback problems end the game instead of waiting
   bool playbackOmniscience;                // whether to reveal all the map during playback
   bool playbackBetweenTurns;               // i.e. waiting for a top-level input -- iff, permit playback commands
   unsigned long nextAnnotationTurn;        // the turn number during which to display the next annotation
@@ -2047,9 +2114,8 @@ struct Feature
 
 #define PDS_FORBIDDEN -1
 #define PDS_OBSTRUCTION -2
-#define PDS_CELL(map, x, y) ((map)->links + ((x) + DCOLS * (y)))
+#define PDS_CELL(x, y) ((x) + DCOLS * (y))  // where (x, y) is in a pdsMap
 
-typedef struct pdsLink pdsLink;
 typedef struct pdsMap pdsMap;
 
 typedef struct BrogueButton
@@ -2113,6 +2179,7 @@ extern "C"
 #endif
 
   void rogueMain();
+  void benchmark();
   void executeEvent(RogueEvent* theEvent);
   bool fileExists(const char* pathname);
   bool chooseFile(char* path, char* prompt, char* defaultName, char* suffix);
@@ -2123,6 +2190,8 @@ extern "C"
   void enableEasyMode();
   int rand_range(int lowerBound, int upperBound);
   unsigned long seedRandomGenerator(unsigned long seed);
+  void getRNGState(unsigned long state[RNG_STATE_WORDS]);
+  void setRNGState(const unsigned long state[RNG_STATE_WORDS]);
   int randClumpedRange(int lowerBound, int upperBound, int clumpFactor);
   int randClump(RandomRange theRange);
   bool rand_percent(int percent);
@@ -2130,6 +2199,7 @@ extern "C"
   void fillSequentialList(int* list, int listLength);
   int unflag(unsigned long flag);
   void considerCautiousMode();
+  void markScreenCellForUpdate(int x, int y);
   void refreshScreen();
   void displayLevel();
   void storeColorComponents(char components[3], const Color* theColor);
@@ -2138,6 +2208,8 @@ extern "C"
   void shuffleTerrainColors(int percentOfCells, bool refreshCells);
   void normColor(Color* baseColor, const int aggregateMultiplier, const int colorTranslation);
   void getCellAppearance(int x, int y, uchar* returnChar, Color* returnForeColor, Color* returnBackColor);
+  void forgetCellAppearances();
+  long benchmarkCellAppearance(unsigned long firstSeed, int seedCount, int depth, int turnCount, FILE* report);
   void logBuffer(char array[DCOLS][DROWS]);
   // void logBuffer(int **array);
   bool search(int searchStrength);
@@ -2155,6 +2227,15 @@ extern "C"
   bool fillSpawnMap(enum dungeonLayers layer, enum TileType surfaceTileType, char spawnMap[DCOLS][DROWS],
                     bool blockedByOtherLayers, bool refresh, bool superpriority);
   bool spawnDungeonFeature(int x, int y, DungeonFeature* Feature, bool refreshCell, bool abortIfBlocking);
+  void rebuildTerrainFlags();
+  void invalidateTerrainFlags();
+  void updateTerrainFlags(int x, int y);
+  void getTerrainFlagCellSet(CellSet* set, unsigned long flags, int left, int right);  // in columns left to right
+  int terrainPlaneCount(enum terrainFlagPlanes plane);
+  bool levelHasGas();
+  int** cachedCostMap(const CostMapProfile* profile);
+  void markCostMapsDirty(int x, int y);
+  void invalidateCostMaps();
   void restoreMonster(Creature* monst, int** mapToStairs, int** mapToPit);
   void restoreItem(Item* theItem);
   void refreshWaypoint(int wpIndex);
@@ -2164,6 +2245,7 @@ extern "C"
 
   void plotChar(uchar inputChar, int xLoc, int yLoc, int backRed, int backGreen, int backBlue, int foreRed,
                 int foreGreen, int foreBlue);
+  void plotCharRun(int xLoc, int yLoc, int length, const cellDisplayBuffer* cells);
   void pausingTimerStartsNow();
   bool pauseForMilliseconds(int milliseconds);
   void nextKeyOrMouseEvent(RogueEvent* returnEvent, bool textInput, bool colorsDance);
@@ -2249,6 +2331,7 @@ extern "C"
   void executeKeystroke(signed long keystroke, bool controlKey, bool shiftKey);
   void initializeLevel();
   void startLevel(int oldLevelNumber, int stairDirection);
+  void updateColors();
   void updateMinersLightRadius();
   void freeCreature(Creature* monst);
   void emptyGraveyard();
@@ -2278,6 +2361,9 @@ extern "C"
   bool playerMoves(int direction);
   void calculateDistances(int** distanceMap, int destinationX, int destinationY, unsigned long blockingTerrainFlags,
                           Creature* traveler, bool canUseSecretDoors, bool eightWays);
+  void calculateDistancesBatch(int** distanceMaps[], const int destinations[][2], int mapCount,
+                               unsigned long blockingTerrainFlags, Creature* traveler, bool canUseSecretDoors,
+                               bool eightWays);
   int pathingDistance(int x1, int y1, int x2, int y2, unsigned long blockingTerrainFlags);
   int nextStep(int** distanceMap, int x, int y, Creature* monst, bool reverseDirections);
   void travelRoute(int path[1000][2], int steps);
@@ -2342,9 +2428,10 @@ extern "C"
 
   void getFOVMask(char grid[DCOLS][DROWS], int xLoc, int yLoc, float maxRadius, unsigned long forbiddenTerrain,
                   unsigned long forbiddenFlags, bool cautiousOnWalls);
-  void scanOctantFOV(char grid[DCOLS][DROWS], int xLoc, int yLoc, int octant, float maxRadius,
-                     int columnsRightFromOrigin, long startSlope, long endSlope, unsigned long forbiddenTerrain,
-                     unsigned long forbiddenFlags, bool cautiousOnWalls);
+  void getFOVBlockers(CellSet* blockers, int xLoc, int yLoc, float maxRadius, unsigned long forbiddenTerrain,
+                      unsigned long forbiddenFlags, const CellSet* flaggedCells = nullptr);
+  void getCautiousFOVMask(char grid[DCOLS][DROWS], int xLoc, int yLoc, float maxRadius, const CellSet* blockers,
+                          std::vector<FOVWallCell>* walls, CellSet* tested);
 
   Creature* generateMonster(int monsterID, bool itemPossible, bool mutationPossible);
   int chooseMonster(int forLevel);
@@ -2543,6 +2630,7 @@ extern "C"
   void flashMonster(Creature* monst, const Color* theColor, int strength);
 
   bool paintLight(LightSource* theLight, int x, int y, bool isMinersLight, bool maintainShadows);
+  void forgetLightContributions();
   void backUpLighting(int lights[DCOLS][DROWS][3]);
   void restoreLighting(int lights[DCOLS][DROWS][3]);
   void updateLighting();
@@ -2566,10 +2654,13 @@ extern "C"
 
   void initRecording();
   void flushBufferToFile();
+  void closeRecordingFile();
   void fillBufferFromFile();
   void recordEvent(RogueEvent* event);
   void recallEvent(RogueEvent* event);
   void pausePlayback();
+  void considerCapturingPlaybackKeyframe();
+  void freePlaybackKeyframes();
   void displayAnnotation();
   void loadSavedGame();
   void recordKeystroke(uchar keystroke, bool controlKey, bool shiftKey);
@@ -2582,6 +2673,7 @@ extern "C"
   bool characterForbiddenInFilename(const char theChar);
   void saveGame();
   void saveRecording();
+  int verifyRecordings(char** paths, int pathCount, int workerCount, FILE* report);
   void parseFile();
   void RNGLog(char* message);
 
@@ -2590,6 +2682,7 @@ extern "C"
   bool dialogChooseFile(char* path, const char* suffix, const char* prompt);
   void dialogAlert(char* message);
   void mainBrogueJunction();
+  void scum(unsigned long startingSeed, int numberOfSeedsToScan, int scanThroughDepth, int workerCount);
 
   void initializeButton(BrogueButton* button);
   void drawButtonsInState(ButtonState* state);
@@ -2602,9 +2695,16 @@ extern "C"
                       RogueEvent* returnEvent);
 
   void dijkstraScan(int** distanceMap, int** costMap, bool useDiagonals);
+  void dijkstraScanBatch(int** distanceMaps[], int mapCount, int** costMap, bool useDiagonals);
+  void dijkstraRepairScan(pdsMap* map, int** distanceMap, int** costMap, bool useDiagonals);
+  pdsMap* allocPdsMap();
+  void freePdsMap(pdsMap* map);
   void pdsClear(pdsMap* map, int maxDistance, bool eightWays);
   void pdsSetDistance(pdsMap* map, int x, int y, int distance);
   void pdsBatchOutput(pdsMap* map, int** distanceMap);
+  long benchmarkDijkstra(unsigned long firstSeed, int seedCount, int depth, FILE* report);
+  long benchmarkDijkstraRepair(unsigned long seed, int count, FILE* report);
+  long benchmarkGridKernels(long rounds, FILE* report);
 
 #if defined __cplusplus
 }
@@ -23,6 +23,7 @@
 
 #include <math.h>
 #include <time.h>
+#include <chrono>
 #include "IncludeGlobals.h"
 #include "Rogue.h"
 
@@ -112,13 +113,15 @@ bool openFile(const char* path)
   return retval;
 }
 
+// Draws 500 screens of random characters. Run headless (--benchmark), it times the drawing code
+// alone, which takes well under a second, so the total is reported in milliseconds.
 void benchmark()
 {
   int i, j, k;
   const Color sparklesauce = { 10, 0, 20, 60, 40, 100, 30, true };
   uchar theChar;
 
-  unsigned long initialTime = (unsigned long)time(nullptr);
+  std::chrono::steady_clock::time_point initialTime = std::chrono::steady_clock::now();
   for (k = 0; k < 500; k++)
   {
     for (i = 0; i < COLS; i++)
@@ -131,7 +134,8 @@ void benchmark()
     }
     pauseBrogue(1);
   }
-  printf("\n\nBenchmark took a total of %lu seconds.", ((unsigned long)time(nullptr)) - initialTime);
+  printf("Benchmark took a total of %.0f milliseconds.\n",
+         std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - initialTime).count());
 }
 
 void welcome()
@@ -222,7 +226,7 @@ void initializeRogue(unsigned long seed)
 {
   int i, j, k;
   Item* theItem;
-  bool playingback, playbackFF, playbackPaused;
+  bool playingback, playbackFF, playbackPaused, playbackHeadless;
   int oldRNG;
 
   // generate libtcod font bitmap
@@ -231,18 +235,21 @@ void initializeRogue(unsigned long seed)
   generateFontFiles();
 #endif
 
-  playingback = rogue.playbackMode;  // the only three animals that need to go on the ark
+  playingback = rogue.playbackMode;  // the only four animals that need to go on the ark
   playbackPaused = rogue.playbackPaused;
   playbackFF = rogue.playbackFastForward;
+  playbackHeadless = rogue.playbackHeadless;
   memset((void*)&rogue, 0, sizeof(PlayerCharacter));  // the flood
   rogue.playbackMode = playingback;
   rogue.playbackPaused = playbackPaused;
   rogue.playbackFastForward = playbackFF;
+  rogue.playbackHeadless = playbackHeadless;
 
   rogue.gameHasEnded = false;
   rogue.highScoreSaved = false;
   rogue.cautiousMode = false;
   rogue.milliseconds = 0;
+  invalidateTerrainFlags();  // until the first level is built
 
   rogue.RNG = RNG_SUBSTANTIVE;
   if (!rogue.playbackMode)
@@ -251,8 +258,6 @@ void initializeRogue(unsigned long seed)
     previousGameSeed = rogue.seed;
   }
 
-  // benchmark();
-
   initRecording();
 
   levels = malloc(sizeof(LevelData) * (DEEPEST_LEVEL + 1));
@@ -614,11 +619,71 @@ void updateColors()
     applyColorAverage(dynamicColors[i][0], dynamicColors[i][2],
                       min(100, max(0, rogue.depthLevel * 100 / AMULET_LEVEL)));
   }
+  forgetCellAppearances();
 }
 
-void startLevel(int oldLevelNumber, int stairDirection)
+// Generates the unvisited level rogue.depthLevel from its seed. What comes out also depends on the game
+// so far: the item metering in rogue (food, life and strength potions, enchant scrolls, gold and
+// reward rooms) that earlier levels' generation left behind, the monsters and items that have fallen
+// into the level, and for the amulet level, the pack. So levels are generated in order, on arrival,
+// and can't be prepared ahead of play without giving a seed a different dungeon.
+static void generateLevel()
 {
   unsigned long oldSeed;
+  Item* theItem;
+  Creature* monst;
+
+  oldSeed = (unsigned long)rand_range(0, 9999);
+  oldSeed += (unsigned long)10000 * rand_range(0, 9999);
+  seedRandomGenerator(levels[rogue.depthLevel - 1].levelSeed);
+
+  // Load up next level's monsters and items, since one might have fallen from above.
+  monsters->nextCreature = levels[rogue.depthLevel - 1].monsters;
+  dormantMonsters->nextCreature = levels[rogue.depthLevel - 1].dormantMonsters;
+  floorItems->nextItem = levels[rogue.depthLevel - 1].items;
+
+  levels[rogue.depthLevel - 1].monsters = nullptr;
+  levels[rogue.depthLevel - 1].dormantMonsters = nullptr;
+  levels[rogue.depthLevel - 1].items = nullptr;
+
+  digDungeon();
+  initializeLevel();
+  rebuildTerrainFlags();
+  setUpWaypoints();
+
+  shuffleTerrainColors(100, false);
+
+  // If we somehow failed to generate the amulet altar,
+  // just toss an amulet in there somewhere.
+  // It'll be fiiine!
+  if (rogue.depthLevel == AMULET_LEVEL && !numberOfMatchingPackItems(AMULET, 0, 0, false) &&
+      levels[rogue.depthLevel - 1].visited == false)
+  {
+    for (theItem = floorItems->nextItem; theItem != nullptr; theItem = theItem->nextItem)
+    {
+      if (theItem->category & AMULET)
+      {
+        break;
+      }
+    }
+    for (monst = monsters->nextCreature; monst != nullptr; monst = monst->nextCreature)
+    {
+      if (monst->carriedItem && (monst->carriedItem->category & AMULET))
+      {
+        theItem = monst->carriedItem;
+        break;
+      }
+    }
+    if (!theItem)
+    {
+      placeItem(generateItem(AMULET, 0), 0, 0);
+    }
+  }
+  seedRandomGenerator(oldSeed);
+}
+
+void startLevel(int oldLevelNumber, int stairDirection)
+{
   Item* theItem;
   int loc[2], i, j, x, y, px, py, flying, dir;
   bool placedPlayer;
@@ -627,6 +692,8 @@ void startLevel(int oldLevelNumber, int stairDirection)
   unsigned long timeAway;
   int** mapToStairs;
   int** mapToPit;
+  int** restoreMaps[2];
+  int restoreDestinations[2][2];
   bool connectingStairsDiscovered;
 
   if (oldLevelNumber == DEEPEST_LEVEL && stairDirection != -1)
@@ -639,6 +706,7 @@ void startLevel(int oldLevelNumber, int stairDirection)
   rogue.updatedSafetyMapThisTurn = false;
   rogue.updatedAllySafetyMapThisTurn = false;
   rogue.updatedMapToSafeTerrainThisTurn = false;
+  forgetLightContributions();
 
   rogue.cursorLoc[0] = -1;
   rogue.cursorLoc[1] = -1;
@@ -770,53 +838,7 @@ void startLevel(int oldLevelNumber, int stairDirection)
     levels[rogue.depthLevel - 1].scentMap = allocGrid();
     scentMap = levels[rogue.depthLevel - 1].scentMap;
     fillGrid(levels[rogue.depthLevel - 1].scentMap, 0);
-    // generate new level
-    oldSeed = (unsigned long)rand_range(0, 9999);
-    oldSeed += (unsigned long)10000 * rand_range(0, 9999);
-    seedRandomGenerator(levels[rogue.depthLevel - 1].levelSeed);
-
-    // Load up next level's monsters and items, since one might have fallen from above.
-    monsters->nextCreature = levels[rogue.depthLevel - 1].monsters;
-    dormantMonsters->nextCreature = levels[rogue.depthLevel - 1].dormantMonsters;
-    floorItems->nextItem = levels[rogue.depthLevel - 1].items;
-
-    levels[rogue.depthLevel - 1].monsters = nullptr;
-    levels[rogue.depthLevel - 1].dormantMonsters = nullptr;
-    levels[rogue.depthLevel - 1].items = nullptr;
-
-    digDungeon();
-    initializeLevel();
-    setUpWaypoints();
-
-    shuffleTerrainColors(100, false);
-
-    // If we somehow failed to generate the amulet altar,
-    // just toss an amulet in there somewhere.
-    // It'll be fiiine!
-    if (rogue.depthLevel == AMULET_LEVEL && !numberOfMatchingPackItems(AMULET, 0, 0, false) &&
-        levels[rogue.depthLevel - 1].visited == false)
-    {
-      for (theItem = floorItems->nextItem; theItem != nullptr; theItem = theItem->nextItem)
-      {
-        if (theItem->category & AMULET)
-        {
-          break;
-        }
-      }
-      for (monst = monsters->nextCreature; monst != nullptr; monst = monst->nextCreature)
-      {
-        if (monst->carriedItem && (monst->carriedItem->category & AMULET))
-        {
-          theItem = monst->carriedItem;
-          break;
-        }
-      }
-      if (!theItem)
-      {
-        placeItem(generateItem(AMULET, 0), 0, 0);
-      }
-    }
-    seedRandomGenerator(oldSeed);
+    generateLevel();
 
     // logLevel();
 
@@ -849,6 +871,7 @@ void startLevel(int oldLevelNumber, int stairDirection)
         pmap[i][j].machineNumber = levels[rogue.depthLevel - 1].mapStorage[i][j].machineNumber;
       }
     }
+    rebuildTerrainFlags();
 
     setUpWaypoints();
 
@@ -874,9 +897,13 @@ void startLevel(int oldLevelNumber, int stairDirection)
     mapToPit = allocGrid();
     fillGrid(mapToStairs, 0);
     fillGrid(mapToPit, 0);
-    calculateDistances(mapToStairs, player.xLoc, player.yLoc, T_PATHING_BLOCKER, nullptr, true, true);
-    calculateDistances(mapToPit, levels[rogue.depthLevel - 1].playerExitedVia[0],
-                       levels[rogue.depthLevel - 1].playerExitedVia[0], T_PATHING_BLOCKER, nullptr, true, true);
+    restoreMaps[0] = mapToStairs;
+    restoreMaps[1] = mapToPit;
+    restoreDestinations[0][0] = player.xLoc;
+    restoreDestinations[0][1] = player.yLoc;
+    restoreDestinations[1][0] = levels[rogue.depthLevel - 1].playerExitedVia[0];
+    restoreDestinations[1][1] = levels[rogue.depthLevel - 1].playerExitedVia[0];
+    calculateDistancesBatch(restoreMaps, restoreDestinations, 2, T_PATHING_BLOCKER, nullptr, true, true);
     for (monst = monsters->nextCreature; monst != nullptr; monst = monst->nextCreature)
     {
       restoreMonster(monst, mapToStairs, mapToPit);
@@ -1045,6 +1072,7 @@ void freeEverything()
 #ifdef AUDIT_RNG
   fclose(RNGLogFile);
 #endif
+  closeRecordingFile();
 
   freeGlobalDynamicGrid(&safetyMap);
   freeGlobalDynamicGrid(&allySafetyMap);
@@ -1191,6 +1219,10 @@ void gameOver(char* killedBy, bool useCustomPhrasing)
 
     do
     {
+      if (rogue.playbackHeadless)
+      {
+        break;  // nobody to press space
+      }
       nextBrogueEvent(&theEvent, false, false, false);
       if (theEvent.eventType == KEYSTROKE && theEvent.param1 != ACKNOWLEDGE_KEY && theEvent.param1 != ESCAPE_KEY &&
           theEvent.param1 != INVENTORY_KEY)
@@ -1427,7 +1459,7 @@ void victory(bool superVictory)
   }
 
   isPlayback = rogue.playbackMode;
-  rogue.playbackMode = false;
+  rogue.playbackMode = rogue.playbackHeadless;  // nobody to press space
   displayMoreSign();
   rogue.playbackMode = isPlayback;
 
@@ -0,0 +1,813 @@
+/*
+ *  Snapshot.cpp
+ *  Brogue++
+ *
+ *  Written by Jason I Mercer
+ *
+ *  Based on code and ideas by Brian Walker
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "IncludeGlobals.h"
+#include "Rogue.h"
+#include "Items.h"
+#include "Snapshot.h"
+
+#define SNAPSHOT_MAGIC "BrogueSnapshot"
+#define SNAPSHOT_LAYOUT_WORDS 8
+
+struct SnapshotHeader
+{
+  char magic[16];
+  char version[16];
+  unsigned long layout[SNAPSHOT_LAYOUT_WORDS];  // must match exactly, or the snapshot is from another build
+  unsigned long length;                         // of the whole snapshot, header included
+  unsigned long seed;
+  unsigned long playerTurnNumber;
+  unsigned long recordingLocation;  // counted as playback counts it, header included
+  unsigned long creatureCount;
+  unsigned long itemCount;
+  unsigned long gridCount;
+};
+
+// The colors that items, creatures and the miner's light can point at, besides the ones in the
+// monster catalog. minersLightColor is thread_local, so the table is built by the thread that uses it.
+#define SNAPSHOT_FIXED_COLORS 11
+#define SNAPSHOT_COLOR_COUNT (1 + SNAPSHOT_FIXED_COLORS + NUMBER_MONSTER_KINDS)
+
+// Pointers are stored as indices into these tables. Index 0 is always nullptr, and creature
+// index 1 is always the player, who isn't heap-allocated.
+struct SnapshotTables
+{
+  std::vector<Creature*> creatures;
+  std::vector<Item*> items;
+  std::vector<int**> grids;
+  std::vector<Color*> colors;
+  std::unordered_map<const void*, uintptr_t> indices;
+};
+
+static void initializeSnapshotTables(SnapshotTables* tables)
+{
+  Color* fixedColors[SNAPSHOT_FIXED_COLORS] = { &white,
+                                                &gray,
+                                                &itemColor,
+                                                &minersLightColor,
+                                                &fireForeColor,
+                                                &torchLightColor,
+                                                &playerInvisibleColor,
+                                                &playerInShadowColor,
+                                                &playerInLightColor,
+                                                &playerInDarknessColor,
+                                                &spectralImageColor };
+  int n;
+
+  tables->creatures.assign(1, nullptr);
+  tables->creatures.push_back(&player);
+  tables->items.assign(1, nullptr);
+  tables->grids.assign(1, nullptr);
+  tables->colors.assign(1, nullptr);
+  tables->colors.insert(tables->colors.end(), fixedColors, fixedColors + SNAPSHOT_FIXED_COLORS);
+  for (n = 0; n < NUMBER_MONSTER_KINDS; n++)
+  {
+    tables->colors.push_back((Color*)monsterCatalog[n].foreColor);
+  }
+  tables->indices.clear();
+  tables->indices[&player] = 1;
+}
+
+// The layout stamp. Structure sizes catch most changes between builds, and the size of the color
+// table catches a monster catalog of a different length.
+static void snapshotLayout(unsigned long layout[SNAPSHOT_LAYOUT_WORDS])
+{
+  layout[0] = sizeof(pcell);
+  layout[1] = sizeof(TCell);
+  layout[2] = sizeof(Creature);
+  layout[3] = sizeof(Item);
+  layout[4] = sizeof(PlayerCharacter);
+  layout[5] = sizeof(LevelData);
+  layout[6] = sizeof(Color);
+  layout[7] = SNAPSHOT_COLOR_COUNT;
+}
+
+// A color pointer is stored as its place in the color table, never as an address: the dynamic
+// colors are thread_local, so their addresses differ between threads and between runs.
+static uintptr_t colorIndex(const SnapshotTables* tables, const Color* color)
+{
+  std::vector<Color*>::const_iterator found = std::find(tables->colors.begin(), tables->colors.end(), color);
+
+  brogueAssert(found != tables->colors.end());
+  return found != tables->colors.end() ? (uintptr_t)(found - tables->colors.begin()) : 0;
+}
+
+#pragma mark Capture
+
+static void noteGrid(SnapshotTables* tables, int** grid)
+{
+  if (grid && !tables->indices.count(grid))
+  {
+    tables->indices[grid] = tables->grids.size();
+    tables->grids.push_back(grid);
+  }
+}
+
+static void noteItemChain(SnapshotTables* tables, Item* theItem)
+{
+  for (; theItem && !tables->indices.count(theItem); theItem = theItem->nextItem)
+  {
+    tables->indices[theItem] = tables->items.size();
+    tables->items.push_back(theItem);
+  }
+}
+
+static void noteCreatureChain(SnapshotTables* tables, Creature* monst)
+{
+  for (; monst && !tables->indices.count(monst); monst = monst->nextCreature)
+  {
+    tables->indices[monst] = tables->creatures.size();
+    tables->creatures.push_back(monst);
+  }
+}
+
+// Creatures can refer to creatures and items that sit outside every chain (a vampire inside its
+// bat, a monster's carried item), so the tables are grown until nothing new turns up.
+static void noteEverything(SnapshotTables* tables)
+{
+  size_t i;
+  int n;
+
+  noteCreatureChain(tables, monsters);
+  noteCreatureChain(tables, dormantMonsters);
+  noteCreatureChain(tables, graveyard);
+  noteCreatureChain(tables, purgatory);
+  noteItemChain(tables, floorItems);
+  noteItemChain(tables, packItems);
+  noteItemChain(tables, monsterItemsHopper);
+  for (n = 0; n < DEEPEST_LEVEL + 1; n++)
+  {
+    noteCreatureChain(tables, levels[n].monsters);
+    noteCreatureChain(tables, levels[n].dormantMonsters);
+    noteItemChain(tables, levels[n].items);
+    noteGrid(tables, levels[n].scentMap);
+  }
+  noteCreatureChain(tables, rogue.yendorWarden);
+  noteCreatureChain(tables, rogue.lastTarget);
+
+  for (i = 1; i < tables->creatures.size(); i++)
+  {
+    Creature* monst = tables->creatures[i];
+    noteCreatureChain(tables, monst->leader);
+    noteCreatureChain(tables, monst->carriedMonster);
+    noteItemChain(tables, monst->carriedItem);
+    noteGrid(tables, monst->mapToMe);
+    noteGrid(tables, monst->safetyMap);
+  }
+
+  noteGrid(tables, scentMap);
+  noteGrid(tables, safetyMap);
+  noteGrid(tables, allySafetyMap);
+  noteGrid(tables, chokeMap);
+  noteGrid(tables, rogue.mapToShore);
+  noteGrid(tables, rogue.mapToSafeTerrain);
+  for (n = 0; n < MAX_WAYPOINT_COUNT; n++)
+  {
+    noteGrid(tables, rogue.wpDistance[n]);
+  }
+}
+
+static uintptr_t indexOf(const SnapshotTables* tables, const void* pointer)
+{
+  if (pointer == nullptr)
+  {
+    return 0;
+  }
+  return tables->indices.at(pointer);
+}
+
+template <typename T>
+static T* asIndex(const SnapshotTables* tables, const void* pointer)
+{
+  return (T*)indexOf(tables, pointer);
+}
+
+static void snapshotPut(GameSnapshot* snapshot, const void* bytes, size_t count)
+{
+  if (snapshot->length + count > snapshot->capacity)
+  {
+    snapshot->capacity = max(snapshot->capacity * 2, snapshot->length + count);
+    snapshot->data = (unsigned char*)realloc(snapshot->data, snapshot->capacity);
+  }
+  memcpy(snapshot->data + snapshot->length, bytes, count);
+  snapshot->length += count;
+}
+
+static void putItemTable(GameSnapshot* snapshot, const ItemTable* table, int kindCount)
+{
+  int i;
+  for (i = 0; i < kindCount; i++)
+  {
+    snapshotPut(snapshot, table[i].callTitle, sizeof(table[i].callTitle));
+    snapshotPut(snapshot, &table[i].frequency, sizeof(table[i].frequency));
+    snapshotPut(snapshot, &table[i].identified, sizeof(table[i].identified));
+    snapshotPut(snapshot, &table[i].called, sizeof(table[i].called));
+  }
+}
+
+// Everything after the header, in the same order that restoreGameSnapshot() reads it.
+static void putGameState(GameSnapshot* snapshot, const SnapshotTables* tables)
+{
+  unsigned long RNGWords[RNG_STATE_WORDS];
+  PlayerCharacter rogueCopy;
+  Creature monstCopy;
+  Item itemCopy;
+  int** heads[4];
+  size_t i;
+  int n;
+
+  for (i = 1; i < tables->grids.size(); i++)
+  {
+    snapshotPut(snapshot, tables->grids[i][0], DCOLS * DROWS * sizeof(int));
+  }
+
+  for (i = 1; i < tables->items.size(); i++)
+  {
+    itemCopy = *tables->items[i];
+    itemCopy.nextItem = asIndex<Item>(tables, itemCopy.nextItem);
+    itemCopy.foreColor = (Color*)colorIndex(tables, itemCopy.foreColor);
+    itemCopy.inventoryColor = (Color*)colorIndex(tables, itemCopy.inventoryColor);
+    snapshotPut(snapshot, &itemCopy, sizeof(Item));
+  }
+
+  for (i = 2; i < tables->creatures.size(); i++)
+  {
+    monstCopy = *tables->creatures[i];
+    monstCopy.info.foreColor = (const Color*)colorIndex(tables, monstCopy.info.foreColor);
+    monstCopy.mapToMe = asIndex<int*>(tables, monstCopy.mapToMe);
+    monstCopy.safetyMap = asIndex<int*>(tables, monstCopy.safetyMap);
+    monstCopy.leader = asIndex<Creature>(tables, monstCopy.leader);
+    monstCopy.carriedMonster = asIndex<Creature>(tables, monstCopy.carriedMonster);
+    monstCopy.nextCreature = asIndex<Creature>(tables, monstCopy.nextCreature);
+    monstCopy.carriedItem = asIndex<Item>(tables, monstCopy.carriedItem);
+    snapshotPut(snapshot, &monstCopy, sizeof(Creature));
+  }
+
+  // Flares are purely visual and die at the end of the turn, so they aren't kept.
+  rogueCopy = rogue;
+  rogueCopy.weapon = asIndex<Item>(tables, rogue.weapon);
+  rogueCopy.armor = asIndex<Item>(tables, rogue.armor);
+  rogueCopy.ringLeft = asIndex<Item>(tables, rogue.ringLeft);
+  rogueCopy.ringRight = asIndex<Item>(tables, rogue.ringRight);
+  rogueCopy.flares = nullptr;
+  rogueCopy.flareCount = rogueCopy.flareCapacity = 0;
+  rogueCopy.yendorWarden = asIndex<Creature>(tables, rogue.yendorWarden);
+  rogueCopy.lastTarget = asIndex<Creature>(tables, rogue.lastTarget);
+  rogueCopy.minersLight.lightColor = (const Color*)colorIndex(tables, rogue.minersLight.lightColor);
+  rogueCopy.mapToShore = asIndex<int*>(tables, rogue.mapToShore);
+  rogueCopy.mapToSafeTerrain = asIndex<int*>(tables, rogue.mapToSafeTerrain);
+  for (n = 0; n < MAX_WAYPOINT_COUNT; n++)
+  {
+    rogueCopy.wpDistance[n] = asIndex<int*>(tables, rogue.wpDistance[n]);
+  }
+  snapshotPut(snapshot, &rogueCopy, sizeof(PlayerCharacter));
+
+  // Only visited levels have anything in their map storage, and it's most of a level's size.
+  for (n = 0; n < DEEPEST_LEVEL + 1; n++)
+  {
+    uintptr_t links[4] = { indexOf(tables, levels[n].items), indexOf(tables, levels[n].monsters),
+                           indexOf(tables, levels[n].dormantMonsters), indexOf(tables, levels[n].scentMap) };
+    snapshotPut(snapshot, &levels[n].visited, sizeof(bool));
+    if (levels[n].visited)
+    {
+      snapshotPut(snapshot, levels[n].mapStorage, sizeof(levels[n].mapStorage));
+    }
+    snapshotPut(snapshot, links, sizeof(links));
+    snapshotPut(snapshot, &levels[n].levelSeed, sizeof(LevelData) - offsetof(LevelData, levelSeed));
+  }
+
+  // The chain heads and global grids, as indices.
+  Creature* creatureHeads[4] = { monsters, dormantMonsters, graveyard, purgatory };
+  Item* itemHeads[3] = { floorItems, packItems, monsterItemsHopper };
+  for (n = 0; n < 4; n++)
+  {
+    uintptr_t index = indexOf(tables, creatureHeads[n]);
+    snapshotPut(snapshot, &index, sizeof(index));
+  }
+  for (n = 0; n < 3; n++)
+  {
+    uintptr_t index = indexOf(tables, itemHeads[n]);
+    snapshotPut(snapshot, &index, sizeof(index));
+  }
+  heads[0] = scentMap;
+  heads[1] = safetyMap;
+  heads[2] = allySafetyMap;
+  heads[3] = chokeMap;
+  for (n = 0; n < 4; n++)
+  {
+    uintptr_t index = indexOf(tables, heads[n]);
+    snapshotPut(snapshot, &index, sizeof(index));
+  }
+
+  monstCopy = player;
+  monstCopy.info.foreColor = (const Color*)colorIndex(tables, player.info.foreColor);
+  monstCopy.mapToMe = asIndex<int*>(tables, player.mapToMe);
+  monstCopy.safetyMap = asIndex<int*>(tables, player.safetyMap);
+  monstCopy.leader = asIndex<Creature>(tables, player.leader);
+  monstCopy.carriedMonster = asIndex<Creature>(tables, player.carriedMonster);
+  monstCopy.nextCreature = asIndex<Creature>(tables, player.nextCreature);
+  monstCopy.carriedItem = asIndex<Item>(tables, player.carriedItem);
+  snapshotPut(snapshot, &monstCopy, sizeof(Creature));
+
+  snapshotPut(snapshot, tmap, sizeof(tmap));
+  snapshotPut(snapshot, pmap, sizeof(pmap));
+  snapshotPut(snapshot, terrainRandomValues, sizeof(terrainRandomValues));
+  snapshotPut(snapshot, displayDetail, sizeof(displayDetail));
+  snapshotPut(snapshot, &numberOfWaypoints, sizeof(numberOfWaypoints));
+
+  snapshotPut(snapshot, displayedMessage, sizeof(displayedMessage));
+  snapshotPut(snapshot, messageConfirmed, sizeof(messageConfirmed));
+  snapshotPut(snapshot, combatText, sizeof(combatText));
+  snapshotPut(snapshot, messageArchive, sizeof(messageArchive));
+  snapshotPut(snapshot, &messageArchivePosition, sizeof(messageArchivePosition));
+
+  getRNGState(RNGWords);
+  snapshotPut(snapshot, RNGWords, sizeof(RNGWords));
+  snapshotPut(snapshot, &randomNumbersGenerated, sizeof(randomNumbersGenerated));
+
+  putItemTable(snapshot, foodTable, NUMBER_FOOD_KINDS);
+  putItemTable(snapshot, weaponTable, NUMBER_WEAPON_KINDS);
+  putItemTable(snapshot, armorTable, NUMBER_ARMOR_KINDS);
+  putItemTable(snapshot, potionTable, NUMBER_POTION_KINDS);
+  putItemTable(snapshot, scrollTable, NUMBER_SCROLL_KINDS);
+  putItemTable(snapshot, wandTable, NUMBER_WAND_KINDS);
+  putItemTable(snapshot, staffTable, NUMBER_STAFF_KINDS);
+  putItemTable(snapshot, ringTable, NUMBER_RING_KINDS);
+  putItemTable(snapshot, charmTable, NUMBER_CHARM_KINDS);
+  snapshotPut(snapshot, itemTitles, sizeof(itemTitles));
+  snapshotPut(snapshot, itemColors, sizeof(itemColors));
+  snapshotPut(snapshot, itemWoods, sizeof(itemWoods));
+  snapshotPut(snapshot, itemMetals, sizeof(itemMetals));
+  snapshotPut(snapshot, itemGems, sizeof(itemGems));
+  for (n = 0; n < NUMBER_DUNGEON_FEATURES; n++)
+  {
+    snapshotPut(snapshot, &dungeonFeatureCatalog[n].messageDisplayed, sizeof(bool));
+  }
+}
+
+void captureGameSnapshot(GameSnapshot* snapshot)
+{
+  SnapshotTables tables;
+  SnapshotHeader header;
+
+  initializeSnapshotTables(&tables);
+  noteEverything(&tables);
+
+  memset(&header, 0, sizeof(header));
+  strcpy(header.magic, SNAPSHOT_MAGIC);
+  strcpy(header.version, BROGUE_VERSION_STRING);
+  snapshotLayout(header.layout);
+  header.seed = rogue.seed;
+  header.playerTurnNumber = rogue.playerTurnNumber;
+  header.recordingLocation = rogue.playbackMode ? recordingLocation : lengthOfPlaybackFile + locationInRecordingBuffer;
+  header.creatureCount = tables.creatures.size();
+  header.itemCount = tables.items.size();
+  header.gridCount = tables.grids.size();
+
+  snapshot->length = 0;
+  snapshotPut(snapshot, &header, sizeof(header));
+  putGameState(snapshot, &tables);
+
+  header.length = snapshot->length;
+  memcpy(snapshot->data, &header, sizeof(header));
+
+  snapshot->seed = header.seed;
+  snapshot->playerTurnNumber = header.playerTurnNumber;
+  snapshot->recordingLocation = header.recordingLocation;
+}
+
+#pragma mark Restore
+
+struct SnapshotReader
+{
+  const unsigned char* data;
+  size_t length;
+  size_t position;
+  bool overrun;
+};
+
+static void snapshotGet(SnapshotReader* reader, void* bytes, size_t count)
+{
+  if (reader->position + count > reader->length)
+  {
+    reader->overrun = true;
+    memset(bytes, 0, count);
+    return;
+  }
+  memcpy(bytes, reader->data + reader->position, count);
+  reader->position += count;
+}
+
+template <typename T>
+static T* atIndex(const std::vector<T*>& table, const void* index)
+{
+  uintptr_t i = (uintptr_t)index;
+  return i < table.size() ? table[i] : nullptr;
+}
+
+static void getItemTable(SnapshotReader* reader, ItemTable* table, int kindCount)
+{
+  int i;
+  for (i = 0; i < kindCount; i++)
+  {
+    snapshotGet(reader, table[i].callTitle, sizeof(table[i].callTitle));
+    snapshotGet(reader, &table[i].frequency, sizeof(table[i].frequency));
+    snapshotGet(reader, &table[i].identified, sizeof(table[i].identified));
+    snapshotGet(reader, &table[i].called, sizeof(table[i].called));
+  }
+}
+
+static void relinkCreature(const SnapshotTables* tables, Creature* monst)
+{
+  monst->info.foreColor = atIndex(tables->colors, monst->info.foreColor);
+  monst->mapToMe = atIndex(tables->grids, monst->mapToMe);
+  monst->safetyMap = atIndex(tables->grids, monst->safetyMap);
+  monst->leader = atIndex(tables->creatures, monst->leader);
+  monst->carriedMonster = atIndex(tables->creatures, monst->carriedMonster);
+  monst->nextCreature = atIndex(tables->creatures, monst->nextCreature);
+  monst->carriedItem = atIndex(tables->items, monst->carriedItem);
+}
+
+// Fields of the rogue struct that describe the session rather than the game: how we are playing
+// (or watching) it, and what to do when it ends. These survive a restore.
+static void keepSessionFields(PlayerCharacter* restored, const PlayerCharacter* session)
+{
+  restored->playbackMode = session->playbackMode;
+  restored->playbackFastForward = session->playbackFastForward;
+  restored->playbackPaused = session->playbackPaused;
+  restored->playbackOOS = session->playbackOOS;
+  restored->playbackHeadless = session->playbackHeadless;
+  restored->playbackOmniscience = session->playbackOmniscience;
+  restored->playbackBetweenTurns = session->playbackBetweenTurns;
+  restored->playbackDelayPerTurn = session->playbackDelayPerTurn;
+  restored->playbackDelayThisTurn = session->playbackDelayThisTurn;
+  restored->howManyTurns = session->howManyTurns;
+  restored->nextAnnotationTurn = session->nextAnnotationTurn;
+  strcpy(restored->nextAnnotation, session->nextAnnotation);
+  restored->locationInAnnotationFile = session->locationInAnnotationFile;
+  restored->nextGame = session->nextGame;
+  strcpy(restored->nextGamePath, session->nextGamePath);
+  restored->nextGameSeed = session->nextGameSeed;
+  restored->trueColorMode = session->trueColorMode;
+  restored->displayAggroRangeMode = session->displayAggroRangeMode;
+}
+
+static size_t itemTableLength(int kindCount)
+{
+  return kindCount * (sizeof(((ItemTable*)nullptr)->callTitle) + sizeof(((ItemTable*)nullptr)->frequency) +
+                      sizeof(((ItemTable*)nullptr)->identified) + sizeof(((ItemTable*)nullptr)->called));
+}
+
+// The part of a snapshot after the levels, which is the same size in every snapshot.
+static size_t snapshotTailLength()
+{
+  return 11 * sizeof(uintptr_t) + sizeof(Creature) + sizeof(tmap) + sizeof(pmap) + sizeof(terrainRandomValues) +
+         sizeof(displayDetail) + sizeof(numberOfWaypoints) + sizeof(displayedMessage) + sizeof(messageConfirmed) +
+         sizeof(combatText) + sizeof(messageArchive) + sizeof(messageArchivePosition) +
+         RNG_STATE_WORDS * sizeof(unsigned long) + sizeof(randomNumbersGenerated) +
+         itemTableLength(NUMBER_FOOD_KINDS) + itemTableLength(NUMBER_WEAPON_KINDS) +
+         itemTableLength(NUMBER_ARMOR_KINDS) + itemTableLength(NUMBER_POTION_KINDS) +
+         itemTableLength(NUMBER_SCROLL_KINDS) + itemTableLength(NUMBER_WAND_KINDS) +
+         itemTableLength(NUMBER_STAFF_KINDS) + itemTableLength(NUMBER_RING_KINDS) +
+         itemTableLength(NUMBER_CHARM_KINDS) + sizeof(itemTitles) + sizeof(itemColors) + sizeof(itemWoods) +
+         sizeof(itemMetals) + sizeof(itemGems) + NUMBER_DUNGEON_FEATURES * sizeof(bool);
+}
+
+// Moves position past count records of size bytes, if they're all there.
+static bool skipRecords(size_t* position, size_t length, unsigned long count, size_t size)
+{
+  if (count > (length - *position) / size)
+  {
+    return false;
+  }
+  *position += count * size;
+  return true;
+}
+
+// Whether the color index stored offset bytes into the record at position names a color in the
+// table.
+static bool colorIsKnown(const GameSnapshot* snapshot, size_t position, size_t offset)
+{
+  uintptr_t index;
+
+  memcpy(&index, snapshot->data + position + offset, sizeof(index));
+  return index < SNAPSHOT_COLOR_COUNT;
+}
+
+// Whether the snapshot is exactly as long as everything its header and level flags say it holds,
+// and every color it stores is one in the color table, worked out without touching the current game.
+static bool snapshotIsWhole(const GameSnapshot* snapshot, const SnapshotHeader* header)
+{
+  const size_t length = snapshot->length;
+  const size_t creatureColor = offsetof(Creature, info) + offsetof(CreatureType, foreColor);
+  size_t position = sizeof(SnapshotHeader), record;
+  unsigned char visited;
+  unsigned long i;
+  int n;
+
+  if (!skipRecords(&position, length, header->gridCount - 1, DCOLS * DROWS * sizeof(int)))
+  {
+    return false;
+  }
+  record = position;
+  if (!skipRecords(&position, length, header->itemCount - 1, sizeof(Item)) ||
+      !skipRecords(&position, length, header->creatureCount - 2, sizeof(Creature)) ||
+      !skipRecords(&position, length, 1, sizeof(PlayerCharacter)))
+  {
+    return false;
+  }
+  for (i = 1; i < header->itemCount; i++, record += sizeof(Item))
+  {
+    if (!colorIsKnown(snapshot, record, offsetof(Item, foreColor)) ||
+        !colorIsKnown(snapshot, record, offsetof(Item, inventoryColor)))
+    {
+      return false;
+    }
+  }
+  for (i = 2; i < header->creatureCount; i++, record += sizeof(Creature))
+  {
+    if (!colorIsKnown(snapshot, record, creatureColor))
+    {
+      return false;
+    }
+  }
+  if (!colorIsKnown(snapshot, record, offsetof(PlayerCharacter, minersLight) + offsetof(LightSource, lightColor)))
+  {
+    return false;
+  }
+  for (n = 0; n < DEEPEST_LEVEL + 1; n++)
+  {
+    if (position + sizeof(bool) > length || snapshot->data[position] > 1)
+    {
+      return false;
+    }
+    visited = snapshot->data[position];
+    position += sizeof(bool);
+    if (!skipRecords(&position, length, visited, sizeof(((LevelData*)nullptr)->mapStorage)) ||
+        !skipRecords(&position, length, 4, sizeof(uintptr_t)) ||
+        !skipRecords(&position, length, 1, sizeof(LevelData) - offsetof(LevelData, levelSeed)))
+    {
+      return false;
+    }
+  }
+  // The player follows the chain heads and global grids at the start of the tail.
+  return length - position == snapshotTailLength() &&
+         colorIsKnown(snapshot, position + 11 * sizeof(uintptr_t), creatureColor);
+}
+
+// Replaces the calling thread's game with the one in the snapshot. Returns false, leaving the
+// current game untouched, if the snapshot was written by a different build, its length doesn't add
+// up or it names a color that isn't in the color table; all are checked before anything is freed.
+// Once they pass, the reads can't run short.
+bool restoreGameSnapshot(const GameSnapshot* snapshot)
+{
+  unsigned long RNGWords[RNG_STATE_WORDS], layout[SNAPSHOT_LAYOUT_WORDS];
+  PlayerCharacter session;
+  SnapshotTables tables;
+  SnapshotHeader header;
+  SnapshotReader reader = { snapshot->data, snapshot->length, 0, false };
+  uintptr_t index;
+  size_t i;
+  int n;
+
+  if (snapshot->data == nullptr || snapshot->length < sizeof(header))
+  {
+    return false;
+  }
+  snapshotGet(&reader, &header, sizeof(header));
+  snapshotLayout(layout);
+  if (strncmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) ||
+      strncmp(header.version, BROGUE_VERSION_STRING, sizeof(header.version)) ||
+      memcmp(header.layout, layout, sizeof(layout)) || header.length != snapshot->length || header.creatureCount < 2 ||
+      header.itemCount < 1 || header.gridCount < 1 || !snapshotIsWhole(snapshot, &header))
+  {
+    return false;
+  }
+
+  session = rogue;
+  freeEverything();
+#ifdef AUDIT_RNG
+  RNGLogFile = fopen(RNG_LOG, "a");
+#endif
+
+  // Allocate everything first, so that links can be resolved as the structs are read.
+  initializeSnapshotTables(&tables);
+  for (i = 1; i < header.gridCount; i++)
+  {
+    tables.grids.push_back(allocGrid());
+  }
+  for (i = 1; i < header.itemCount; i++)
+  {
+    tables.items.push_back((Item*)malloc(sizeof(Item)));
+  }
+  for (i = 2; i < header.creatureCount; i++)
+  {
+    tables.creatures.push_back((Creature*)malloc(sizeof(Creature)));
+  }
+
+  for (i = 1; i < tables.grids.size(); i++)
+  {
+    snapshotGet(&reader, tables.grids[i][0], DCOLS * DROWS * sizeof(int));
+  }
+
+  for (i = 1; i < tables.items.size(); i++)
+  {
+    Item* theItem = tables.items[i];
+    snapshotGet(&reader, theItem, sizeof(Item));
+    theItem->nextItem = atIndex(tables.items, theItem->nextItem);
+    theItem->foreColor = atIndex(tables.colors, theItem->foreColor);
+    theItem->inventoryColor = atIndex(tables.colors, theItem->inventoryColor);
+  }
+
+  for (i = 2; i < tables.creatures.size(); i++)
+  {
+    snapshotGet(&reader, tables.creatures[i], sizeof(Creature));
+    relinkCreature(&tables, tables.creatures[i]);
+  }
+
+  snapshotGet(&reader, &rogue, sizeof(PlayerCharacter));
+  rogue.weapon = atIndex(tables.items, rogue.weapon);
+  rogue.armor = atIndex(tables.items, rogue.armor);
+  rogue.ringLeft = atIndex(tables.items, rogue.ringLeft);
+  rogue.ringRight = atIndex(tables.items, rogue.ringRight);
+  rogue.yendorWarden = atIndex(tables.creatures, rogue.yendorWarden);
+  rogue.lastTarget = atIndex(tables.creatures, rogue.lastTarget);
+  rogue.minersLight.lightColor = atIndex(tables.colors, rogue.minersLight.lightColor);
+  rogue.mapToShore = atIndex(tables.grids, rogue.mapToShore);
+  rogue.mapToSafeTerrain = atIndex(tables.grids, rogue.mapToSafeTerrain);
+  for (n = 0; n < MAX_WAYPOINT_COUNT; n++)
+  {
+    rogue.wpDistance[n] = atIndex(tables.grids, rogue.wpDistance[n]);
+  }
+  keepSessionFields(&rogue, &session);
+
+  levels = (LevelData*)malloc(sizeof(LevelData) * (DEEPEST_LEVEL + 1));
+  for (n = 0; n < DEEPEST_LEVEL + 1; n++)
+  {
+    uintptr_t links[4];
+    snapshotGet(&reader, &levels[n].visited, sizeof(bool));
+    if (levels[n].visited)
+    {
+      snapshotGet(&reader, levels[n].mapStorage, sizeof(levels[n].mapStorage));
+    }
+    snapshotGet(&reader, links, sizeof(links));
+    snapshotGet(&reader, &levels[n].levelSeed, sizeof(LevelData) - offsetof(LevelData, levelSeed));
+    levels[n].items = atIndex(tables.items, (const void*)links[0]);
+    levels[n].monsters = atIndex(tables.creatures, (const void*)links[1]);
+    levels[n].dormantMonsters = atIndex(tables.creatures, (const void*)links[2]);
+    levels[n].scentMap = atIndex(tables.grids, (const void*)links[3]);
+  }
+
+  Creature** creatureHeads[4] = { &monsters, &dormantMonsters, &graveyard, &purgatory };
+  Item** itemHeads[3] = { &floorItems, &packItems, &monsterItemsHopper };
+  int*** gridHeads[4] = { &scentMap, &safetyMap, &allySafetyMap, &chokeMap };
+  for (n = 0; n < 4; n++)
+  {
+    snapshotGet(&reader, &index, sizeof(index));
+    *creatureHeads[n] = atIndex(tables.creatures, (const void*)index);
+  }
+  for (n = 0; n < 3; n++)
+  {
+    snapshotGet(&reader, &index, sizeof(index));
+    *itemHeads[n] = atIndex(tables.items, (const void*)index);
+  }
+  for (n = 0; n < 4; n++)
+  {
+    snapshotGet(&reader, &index, sizeof(index));
+    *gridHeads[n] = atIndex(tables.grids, (const void*)index);
+  }
+
+  snapshotGet(&reader, &player, sizeof(Creature));
+  relinkCreature(&tables, &player);
+
+  snapshotGet(&reader, tmap, sizeof(tmap));
+  snapshotGet(&reader, pmap, sizeof(pmap));
+  rebuildTerrainFlags();
+  snapshotGet(&reader, terrainRandomValues, sizeof(terrainRandomValues));
+  snapshotGet(&reader, displayDetail, sizeof(displayDetail));
+  snapshotGet(&reader, &numberOfWaypoints, sizeof(numberOfWaypoints));
+
+  snapshotGet(&reader, displayedMessage, sizeof(displayedMessage));
+  snapshotGet(&reader, messageConfirmed, sizeof(messageConfirmed));
+  snapshotGet(&reader, combatText, sizeof(combatText));
+  snapshotGet(&reader, messageArchive, sizeof(messageArchive));
+  snapshotGet(&reader, &messageArchivePosition, sizeof(messageArchivePosition));
+
+  snapshotGet(&reader, RNGWords, sizeof(RNGWords));
+  setRNGState(RNGWords);
+  snapshotGet(&reader, &randomNumbersGenerated, sizeof(randomNumbersGenerated));
+
+  getItemTable(&reader, foodTable, NUMBER_FOOD_KINDS);
+  getItemTable(&reader, weaponTable, NUMBER_WEAPON_KINDS);
+  getItemTable(&reader, armorTable, NUMBER_ARMOR_KINDS);
+  getItemTable(&reader, potionTable, NUMBER_POTION_KINDS);
+  getItemTable(&reader, scrollTable, NUMBER_SCROLL_KINDS);
+  getItemTable(&reader, wandTable, NUMBER_WAND_KINDS);
+  getItemTable(&reader, staffTable, NUMBER_STAFF_KINDS);
+  getItemTable(&reader, ringTable, NUMBER_RING_KINDS);
+  getItemTable(&reader, charmTable, NUMBER_CHARM_KINDS);
+  snapshotGet(&reader, itemTitles, sizeof(itemTitles));
+  snapshotGet(&reader, itemColors, sizeof(itemColors));
+  snapshotGet(&reader, itemWoods, sizeof(itemWoods));
+  snapshotGet(&reader, itemMetals, sizeof(itemMetals));
+  snapshotGet(&reader, itemGems, sizeof(itemGems));
+  for (n = 0; n < NUMBER_DUNGEON_FEATURES; n++)
+  {
+    snapshotGet(&reader, &dungeonFeatureCatalog[n].messageDisplayed, sizeof(bool));
+  }
+
+  recordingLocation = header.recordingLocation;
+
+  brogueAssert(!reader.overrun && reader.position == reader.length);
+  return !reader.overrun;
+}
+
+void freeGameSnapshot(GameSnapshot* snapshot)
+{
+  free(snapshot->data);
+  memset(snapshot, 0, sizeof(GameSnapshot));
+}
+
+#pragma mark Files
+
+bool writeGameSnapshot(const GameSnapshot* snapshot, const char* path)
+{
+  FILE* snapshotFile;
+  bool written;
+
+  snapshotFile = fopen(path, "wb");
+  if (snapshotFile == nullptr)
+  {
+    return false;
+  }
+  written = (fwrite(snapshot->data, 1, snapshot->length, snapshotFile) == snapshot->length);
+  written = (fclose(snapshotFile) == 0) && written;
+  if (!written)
+  {
+    remove(path);
+  }
+  return written;
+}
+
+bool readGameSnapshot(GameSnapshot* snapshot, const char* path)
+{
+  SnapshotHeader header;
+  FILE* snapshotFile;
+  long length;
+
+  snapshotFile = fopen(path, "rb");
+  if (snapshotFile == nullptr)
+  {
+    return false;
+  }
+  fseek(snapshotFile, 0, SEEK_END);
+  length = ftell(snapshotFile);
+  rewind(snapshotFile);
+
+  if (length < (long)sizeof(header))
+  {
+    fclose(snapshotFile);
+    return false;
+  }
+
+  snapshot->data = (unsigned char*)realloc(snapshot->data, length);
+  snapshot->capacity = snapshot->length = length;
+  if (fread(snapshot->data, 1, length, snapshotFile) != (size_t)length)
+  {
+    fclose(snapshotFile);
+    snapshot->length = 0;
+    return false;
+  }
+  fclose(snapshotFile);
+
+  memcpy(&header, snapshot->data, sizeof(header));
+  snapshot->seed = header.seed;
+  snapshot->playerTurnNumber = header.playerTurnNumber;
+  snapshot->recordingLocation = header.recordingLocation;
+  return true;
+}
@@ -0,0 +1,50 @@
+/*
+ *  Snapshot.h
+ *  Brogue++
+ *
+ *  Written by Jason I Mercer
+ *
+ *  Based on code and ideas by Brian Walker
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+
+// The complete state of the calling thread's game, flattened into bytes: the maps, every level,
+// the creature and item chains (with their links stored as indices), the rogue and player structs,
+// the per-game item tables and the RNG state. Snapshots are only meaningful to the build that
+// wrote them; restoring one from another build fails cleanly.
+struct GameSnapshot
+{
+  unsigned char* data;
+  size_t length;
+  size_t capacity;
+
+  unsigned long seed;                // identify the recording that the snapshot belongs to
+  unsigned long playerTurnNumber;
+  unsigned long recordingLocation;
+};
+
+void captureGameSnapshot(GameSnapshot* snapshot);
+bool restoreGameSnapshot(const GameSnapshot* snapshot);
+void freeGameSnapshot(GameSnapshot* snapshot);
+
+bool writeGameSnapshot(const GameSnapshot* snapshot, const char* path);
+bool readGameSnapshot(GameSnapshot* snapshot, const char* path);
+
+#endif  // SNAPSHOT_H
@@ -0,0 +1,221 @@
+/*
+ *  TerrainFlags.cpp
+ *  Brogue++
+ *
+ *  Written by Jason I Mercer
+ *
+ *  Based on code and ideas by Brian Walker
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "IncludeGlobals.h"
+#include "Rogue.h"
+#include "Grid.h"
+
+static_assert(DROWS <= 32, "a terrain flag plane keeps a column in one unsigned long");
+
+thread_local TerrainFlagCache terrainFlagCache;
+
+// The terrain flags behind each plane, in enum terrainFlagPlanes order.
+static const unsigned long planeFlags[NUMBER_TERRAIN_FLAG_PLANES] = {
+    T_OBSTRUCTS_PASSABILITY,
+    T_OBSTRUCTS_VISION,
+    T_OBSTRUCTS_GAS,
+    T_PATHING_BLOCKER,
+    T_IS_FIRE,
+};
+
+static void cacheCell(int x, int y)
+{
+  const unsigned long flags = layerTerrainFlags(x, y);
+  const unsigned long bit = 1UL << y;
+  int plane, layer;
+  bool promotable = false;
+
+  terrainFlagCache.flags[x][y] = flags;
+  terrainFlagCache.mechFlags[x][y] = layerTerrainMechFlags(x, y);
+  for (plane = 0; plane < NUMBER_TERRAIN_FLAG_PLANES; plane++)
+  {
+    if (flags & planeFlags[plane])
+    {
+      terrainFlagCache.planes[plane][x] |= bit;
+    }
+    else
+    {
+      terrainFlagCache.planes[plane][x] &= ~bit;
+    }
+  }
+
+  // Gas comes and goes through the gas layer, so it's tracked here too. Volume is only ever added along
+  // with the layer; updateVolumetricMedia() clears the volume bits as the gas thins out.
+  if (pmap[x][y].layers[GAS] != NOTHING)
+  {
+    terrainFlagCache.gasColumns[x] |= bit;
+  }
+  else
+  {
+    terrainFlagCache.gasColumns[x] &= ~bit;
+  }
+  if (pmap[x][y].volume > 0)
+  {
+    terrainFlagCache.gasVolumeColumns[x] |= bit;
+  }
+  else
+  {
+    terrainFlagCache.gasVolumeColumns[x] &= ~bit;
+  }
+
+  // And so are the cells that updateEnvironment() might promote.
+  for (layer = 0; layer < NUMBER_TERRAIN_LAYERS; layer++)
+  {
+    if (tileCatalog[pmap[x][y].layers[layer]].promoteChance)
+    {
+      promotable = true;
+    }
+  }
+  if (promotable)
+  {
+    terrainFlagCache.promotableColumns[x] |= bit;
+  }
+  else
+  {
+    terrainFlagCache.promotableColumns[x] &= ~bit;
+  }
+}
+
+// Recomputes the whole level from its layers and starts serving terrainFlags() from the cache.
+// Called once a level has been generated or restored.
+void rebuildTerrainFlags()
+{
+  int i, j;
+
+  for (i = 0; i < DCOLS; i++)
+  {
+    for (j = 0; j < DROWS; j++)
+    {
+      cacheCell(i, j);
+    }
+  }
+  terrainFlagCache.valid = true;
+  invalidateCostMaps();
+}
+
+// For code that rewrites layers without telling the cache: terrainFlags() reads the layers directly
+// until the next rebuildTerrainFlags().
+void invalidateTerrainFlags()
+{
+  terrainFlagCache.valid = false;
+  invalidateCostMaps();
+}
+
+// Call after changing any layer of (x, y).
+void updateTerrainFlags(int x, int y)
+{
+  if (terrainFlagCache.valid)
+  {
+    cacheCell(x, y);
+    markCostMapsDirty(x, y);
+  }
+}
+
+// Whether any cell has a gas layer: a column at a time from the cache, or cell by cell without it.
+bool levelHasGas()
+{
+  int i, j;
+
+  if (terrainFlagCache.valid)
+  {
+    for (i = 0; i < DCOLS; i++)
+    {
+      if (terrainFlagCache.gasColumns[i])
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+  for (i = 0; i < DCOLS; i++)
+  {
+    for (j = 0; j < DROWS; j++)
+    {
+      if (pmap[i][j].layers[GAS])
+      {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// How many cells of the level are in the plane, a column at a time.
+int terrainPlaneCount(enum terrainFlagPlanes plane)
+{
+  unsigned long column;
+  int i, count = 0;
+
+  for (i = 0; i < DCOLS; i++)
+  {
+    for (column = terrainPlaneColumn(plane, i); column; column &= column - 1)
+    {
+      count++;
+    }
+  }
+  return count;
+}
+
+// Sets the cells of columns left through right whose terrain has any of flags, and clears the rest of
+// those columns. When flags is made up of whole planes, each column is ORed together from them.
+void getTerrainFlagCellSet(CellSet* set, unsigned long flags, int left, int right)
+{
+  unsigned long covered = 0, column;
+  int plane, i, j;
+
+  if (terrainFlagCache.valid)
+  {
+    for (plane = 0; plane < NUMBER_TERRAIN_FLAG_PLANES; plane++)
+    {
+      if (!(planeFlags[plane] & ~flags))
+      {
+        covered |= planeFlags[plane];
+      }
+    }
+  }
+
+  for (i = left; i <= right; i++)
+  {
+    column = 0;
+    if (terrainFlagCache.valid && covered == flags)
+    {
+      for (plane = 0; plane < NUMBER_TERRAIN_FLAG_PLANES; plane++)
+      {
+        if (!(planeFlags[plane] & ~flags))
+        {
+          column |= terrainFlagCache.planes[plane][i];
+        }
+      }
+    }
+    else
+    {
+      for (j = 0; j < DROWS; j++)
+      {
+        if (cellHasTerrainFlag(i, j, flags))
+        {
+          column |= 1UL << j;
+        }
+      }
+    }
+    set->columns[i] = column;
+  }
+}
@@ -24,6 +24,8 @@
 #include <math.h>
 #include "IncludeGlobals.h"
 #include "Rogue.h"
+#include "Grid.h"
+#include "GameContext.h"
 
 void exposeCreatureToFire(Creature* monst)
 {
@@ -828,6 +830,7 @@ void discoverCell(const int x, const int y)
   if (!(pmap[x][y].flags & DISCOVERED))
   {
     pmap[x][y].flags |= DISCOVERED;
+    markCostMapsDirty(x, y);
     if (!cellHasTerrainFlag(x, y, T_PATHING_BLOCKER))
     {
       rogue.xpxpThisTurn++;
@@ -1257,6 +1260,7 @@ void promoteTile(int x, int y, enum dungeonLayers layer, bool useFireDF)
     }
     pmap[x][y].layers[layer] =
         (layer == DUNGEON ? FLOOR : NOTHING);  // even the dungeon layer implicitly has floor underneath it
+    updateTerrainFlags(x, y);
     if (layer == GAS)
     {
       pmap[x][y].volume = 0;
@@ -1384,6 +1388,60 @@ bool exposeTileToFire(int x, int y, bool alwaysIgnite)
 }
 
 // Only the gas layer can be volumetric.
+// The cells a gas pass can change: those with gas or gas volume, and their neighbors. Without the
+// terrain flag cache, that's everywhere.
+static void findActiveGasCells(CellSet* active)
+{
+  unsigned long column;
+  int i;
+
+  if (!terrainFlagCache.valid)
+  {
+    for (i = 0; i < DCOLS; i++)
+    {
+      active->columns[i] = (1UL << DROWS) - 1;
+    }
+    return;
+  }
+  for (i = 0; i < DCOLS; i++)
+  {
+    column = terrainFlagCache.gasColumns[i] | terrainFlagCache.gasVolumeColumns[i];
+    if (i > 0)
+    {
+      column |= terrainFlagCache.gasColumns[i - 1] | terrainFlagCache.gasVolumeColumns[i - 1];
+    }
+    if (i < DCOLS - 1)
+    {
+      column |= terrainFlagCache.gasColumns[i + 1] | terrainFlagCache.gasVolumeColumns[i + 1];
+    }
+    active->columns[i] = (column | (column << 1) | (column >> 1)) & ((1UL << DROWS) - 1);
+  }
+}
+
+// A cell with no gas anywhere around it comes out of a pass just as it went in, but it still makes the
+// stochastic rounding draw, so that the substantive RNG sees the same calls as it would if every cell
+// were worked out.
+static void skipGasCell(int x, int y)
+{
+  int newX, newY, numSpaces = 1;
+  enum Directions dir;
+
+  for (dir = 0; dir < DIRECTION_COUNT; dir++)
+  {
+    newX = x + nbDirs[dir][0];
+    newY = y + nbDirs[dir][1];
+    if (coordinatesAreInMap(newX, newY) && !cellIsInTerrainPlane(newX, newY, PLANE_OBSTRUCTS_GAS))
+    {
+      numSpaces++;
+    }
+  }
+  if (cellHasTerrainFlag(x, y, T_AUTO_DESCENT))
+  {
+    numSpaces++;
+  }
+  rand_range(0, numSpaces - 1);
+}
+
 void updateVolumetricMedia()
 {
   int i, j, newX, newY, numSpaces;
@@ -1392,12 +1450,18 @@ void updateVolumetricMedia()
   enum TileType gasType;
   enum Directions dir;
   unsigned int newGasVolume[DCOLS][DROWS];
+  CellSet active;
 
+  // Only the cells with gas around them are simulated; the rest only make their RNG draw.
+  findActiveGasCells(&active);
   for (i = 0; i < DCOLS; i++)
   {
     for (j = 0; j < DROWS; j++)
     {
-      newGasVolume[i][j] = 0;
+      if (active.contains(i, j))
+      {
+        newGasVolume[i][j] = 0;
+      }
     }
   }
 
@@ -1405,7 +1469,14 @@ void updateVolumetricMedia()
   {
     for (j = 0; j < DROWS; j++)
     {
-      if (!cellHasTerrainFlag(i, j, T_OBSTRUCTS_GAS))
+      if (!active.contains(i, j))
+      {
+        if (!cellIsInTerrainPlane(i, j, PLANE_OBSTRUCTS_GAS))
+        {
+          skipGasCell(i, j);
+        }
+      }
+      else if (!cellHasTerrainFlag(i, j, T_OBSTRUCTS_GAS))
       {
         sum = pmap[i][j].volume;
         numSpaces = 1;
@@ -1442,10 +1513,12 @@ void updateVolumetricMedia()
             newGasVolume[i][j] = min(3, newGasVolume[i][j]);  // otherwise interactions between gases are crazy
           }
           pmap[i][j].layers[GAS] = gasType;
+          updateTerrainFlags(i, j);
         }
         else if (pmap[i][j].layers[GAS] && newGasVolume[i][j] < 1)
         {
           pmap[i][j].layers[GAS] = NOTHING;
+          updateTerrainFlags(i, j);
           refreshDungeonCell(i, j);
         }
         if (pmap[i][j].volume > 0)
@@ -1485,12 +1558,14 @@ void updateVolumetricMedia()
               if (pmap[i][j].volume / numSpaces)
               {
                 pmap[newX][newY].layers[GAS] = pmap[i][j].layers[GAS];
+                updateTerrainFlags(newX, newY);
               }
             }
           }
         }
         newGasVolume[i][j] = 0;
         pmap[i][j].layers[GAS] = NOTHING;
+        updateTerrainFlags(i, j);
       }
     }
   }
@@ -1499,10 +1574,21 @@ void updateVolumetricMedia()
   {
     for (j = 0; j < DROWS; j++)
     {
-      if (pmap[i][j].volume != newGasVolume[i][j])
+      if (active.contains(i, j))
       {
-        pmap[i][j].volume = newGasVolume[i][j];
-        refreshDungeonCell(i, j);
+        if (pmap[i][j].volume != newGasVolume[i][j])
+        {
+          pmap[i][j].volume = newGasVolume[i][j];
+          refreshDungeonCell(i, j);
+        }
+        if (pmap[i][j].volume == 0)
+        {
+          terrainFlagCache.gasVolumeColumns[i] &= ~(1UL << j);
+        }
+        else
+        {
+          terrainFlagCache.gasVolumeColumns[i] |= 1UL << j;
+        }
       }
     }
   }
@@ -1626,36 +1712,31 @@ void monstersFall()
 void updateEnvironment()
 {
   int i, j, direction, newX, newY, promotions[DCOLS][DROWS];
+  unsigned long column;
+  CellSet promoting;
   long promoteChance;
   enum dungeonLayers layer;
   FloorTileType* tile;
-  bool isVolumetricGas = false;
 
   monstersFall();
 
   // update gases twice
-  for (i = 0; i < DCOLS && !isVolumetricGas; i++)
-  {
-    for (j = 0; j < DROWS && !isVolumetricGas; j++)
-    {
-      if (!isVolumetricGas && pmap[i][j].layers[GAS])
-      {
-        isVolumetricGas = true;
-      }
-    }
-  }
-  if (isVolumetricGas)
+  if (levelHasGas())
   {
     updateVolumetricMedia();
     updateVolumetricMedia();
   }
 
   // Do random tile promotions in two passes to keep generations distinct.
-  // First pass, make a note of each terrain layer at each coordinate that is going to promote:
+  // First pass, make a note of each terrain layer at each coordinate that is going to promote. Only cells
+  // with a promotable layer can, and they're visited in the same order as ever, so the RNG is too:
+  promoting.clear();
   for (i = 0; i < DCOLS; i++)
   {
-    for (j = 0; j < DROWS; j++)
+    column = (terrainFlagCache.valid ? terrainFlagCache.promotableColumns[i] : (1UL << DROWS) - 1);
+    for (; column; column &= column - 1)
     {
+      j = lowestRow(column);
       promotions[i][j] = 0;
       for (layer = 0; layer < NUMBER_TERRAIN_LAYERS; layer++)
       {
@@ -1681,6 +1762,7 @@ void updateEnvironment()
         if (promoteChance && !(pmap[i][j].flags & CAUGHT_FIRE_THIS_TURN) && rand_range(0, 10000) < promoteChance)
         {
           promotions[i][j] |= Fl(layer);
+          promoting.add(i, j);
           // promoteTile(i, j, layer, false);
         }
       }
@@ -1689,8 +1771,9 @@ void updateEnvironment()
   // Second pass, do the promotions:
   for (i = 0; i < DCOLS; i++)
   {
-    for (j = 0; j < DROWS; j++)
+    for (column = promoting.columns[i]; column; column &= column - 1)
     {
+      j = lowestRow(column);
       for (layer = 0; layer < NUMBER_TERRAIN_LAYERS; layer++)
       {
         if ((promotions[i][j] & Fl(layer)))
@@ -1726,11 +1809,21 @@ void updateEnvironment()
     }
   }
 
-  // Update fire.
+  // Update fire. Fire spreads as we go, so the fire plane is read afresh for each cell, but the cells
+  // with no fire are skipped a column at a time.
   for (i = 0; i < DCOLS; i++)
   {
     for (j = 0; j < DROWS; j++)
     {
+      if (terrainFlagCache.valid)
+      {
+        column = terrainPlaneColumn(PLANE_IS_FIRE, i) >> j;
+        if (!column)
+        {
+          break;
+        }
+        j += lowestRow(column);
+      }
       if (cellHasTerrainFlag(i, j, T_IS_FIRE) && !(pmap[i][j].flags & CAUGHT_FIRE_THIS_TURN))
       {
         exposeTileToFire(i, j, false);
@@ -1754,13 +1847,11 @@ void updateEnvironment()
 void updateAllySafetyMap()
 {
   int i, j;
-  int **playerCostMap, **monsterCostMap;
+  Grid<int> playerCostMap, monsterCostMap;
+  pdsMap** scans = currentGameContext()->rememberedScans;
 
   rogue.updatedAllySafetyMapThisTurn = true;
 
-  playerCostMap = allocGrid();
-  monsterCostMap = allocGrid();
-
   for (i = 0; i < DCOLS; i++)
   {
     for (j = 0; j < DROWS; j++)
@@ -1791,7 +1882,7 @@ void updateAllySafetyMap()
   playerCostMap[player.xLoc][player.yLoc] = PDS_FORBIDDEN;
   monsterCostMap[player.xLoc][player.yLoc] = PDS_FORBIDDEN;
 
-  dijkstraScan(allySafetyMap, playerCostMap, false);
+  dijkstraRepairScan(scans[ALLY_SAFETY_DISTANCE_SCAN], allySafetyMap, playerCostMap, false);
 
   for (i = 0; i < DCOLS; i++)
   {
@@ -1817,10 +1908,7 @@ void updateAllySafetyMap()
       }
     }
   }
-  dijkstraScan(allySafetyMap, monsterCostMap, false);
-
-  freeGrid(playerCostMap);
-  freeGrid(monsterCostMap);
+  dijkstraRepairScan(scans[ALLY_SAFETY_FLIGHT_SCAN], allySafetyMap, monsterCostMap, false);
 }
 
 void resetDistanceCellInGrid(int** grid, int x, int y)
@@ -1841,14 +1929,12 @@ void resetDistanceCellInGrid(int** grid, int x, int y)
 void updateSafetyMap()
 {
   int i, j;
-  int **playerCostMap, **monsterCostMap;
+  Grid<int> playerCostMap, monsterCostMap;
   Creature* monst;
+  pdsMap** scans = currentGameContext()->rememberedScans;
 
   rogue.updatedSafetyMapThisTurn = true;
 
-  playerCostMap = allocGrid();
-  monsterCostMap = allocGrid();
-
   for (i = 0; i < DCOLS; i++)
   {
     for (j = 0; j < DROWS; j++)
@@ -1951,7 +2037,7 @@ void updateSafetyMap()
   playerCostMap[rogue.downLoc[0]][rogue.downLoc[1]] = PDS_FORBIDDEN;
   monsterCostMap[rogue.downLoc[0]][rogue.downLoc[1]] = PDS_FORBIDDEN;
 
-  dijkstraScan(safetyMap, playerCostMap, false);
+  dijkstraRepairScan(scans[SAFETY_DISTANCE_SCAN], safetyMap, playerCostMap, false);
 
   for (i = 0; i < DCOLS; i++)
   {
@@ -1991,7 +2077,7 @@ void updateSafetyMap()
       }
     }
   }
-  dijkstraScan(safetyMap, monsterCostMap, false);
+  dijkstraRepairScan(scans[SAFETY_FLIGHT_SCAN], safetyMap, monsterCostMap, false);
   for (i = 0; i < DCOLS; i++)
   {
     for (j = 0; j < DROWS; j++)
@@ -2002,18 +2088,15 @@ void updateSafetyMap()
       }
     }
   }
-  freeGrid(playerCostMap);
-  freeGrid(monsterCostMap);
 }
 
 void updateSafeTerrainMap()
 {
   int i, j;
-  int** costMap;
+  Grid<int> costMap;
   Creature* monst;
 
   rogue.updatedMapToSafeTerrainThisTurn = true;
-  costMap = allocGrid();
 
   for (i = 0; i < DCOLS; i++)
   {
@@ -2051,7 +2134,6 @@ void updateSafeTerrainMap()
     }
   }
   dijkstraScan(rogue.mapToSafeTerrain, costMap, false);
-  freeGrid(costMap);
 }
 
 void processIncrementalAutoID()
@@ -24,21 +24,7 @@ static void gameLoop() {
 	Term.end();
 }
 
-static void curses_plotChar(uchar ch,
-			  short xLoc, short yLoc,
-			  short foreRed, short foreGreen, short foreBlue,
-			  short backRed, short backGreen, short backBlue) {
-	
-	fcolor fore;
-	fcolor back;
-	
-	fore.r = (float) foreRed / 100;
-	fore.g = (float) foreGreen / 100;
-	fore.b = (float) foreBlue / 100;
-	back.r = (float) backRed / 100;
-	back.g = (float) backGreen / 100;
-	back.b = (float) backBlue / 100;
-
+static uchar curses_glyph(uchar ch) {
 	#ifdef USE_UNICODE
 	// because we can't look at unicode and ascii without messing with Rogue.h, reinterpret until some later version comes along:
 	switch (ch) {
@@ -80,7 +66,46 @@ static void curses_plotChar(uchar ch,
 	#endif
 	
 	if (ch < ' ' || ch > 127) ch = ' ';
-	Term.put(xLoc, yLoc, ch, &fore, &back);
+	return ch;
+}
+
+static void curses_plotChar(uchar ch,
+			  short xLoc, short yLoc,
+			  short foreRed, short foreGreen, short foreBlue,
+			  short backRed, short backGreen, short backBlue) {
+	
+	fcolor fore;
+	fcolor back;
+	
+	fore.r = (float) foreRed / 100;
+	fore.g = (float) foreGreen / 100;
+	fore.b = (float) foreBlue / 100;
+	back.r = (float) backRed / 100;
+	back.g = (float) backGreen / 100;
+	back.b = (float) backBlue / 100;
+
+	Term.put(xLoc, yLoc, curses_glyph(ch), &fore, &back);
+}
+
+// neighbouring cells often share colors, so only convert them when they change
+static void curses_plotRun(short xLoc, short yLoc, short length, const cellDisplayBuffer *cells) {
+	fcolor fore, back;
+	int i;
+
+	for (i = 0; i < length; i++) {
+		const char *f = cells[i].foreColorComponents, *b = cells[i].backColorComponents;
+		if (i == 0 || memcmp(f, cells[i - 1].foreColorComponents, 3)) {
+			fore.r = (float) f[0] / 100;
+			fore.g = (float) f[1] / 100;
+			fore.b = (float) f[2] / 100;
+		}
+		if (i == 0 || memcmp(b, cells[i - 1].backColorComponents, 3)) {
+			back.r = (float) b[0] / 100;
+			back.g = (float) b[1] / 100;
+			back.b = (float) b[2] / 100;
+		}
+		Term.put(xLoc + i, yLoc, curses_glyph(cells[i].character), &fore, &back);
+	}
 }
 
 
@@ -221,7 +246,8 @@ struct brogueConsole cursesConsole = {
 	curses_nextKeyOrMouseEvent,
 	curses_plotChar,
 	curses_remap,
-	modifier_held
+	modifier_held,
+	curses_plotRun
 };
 #endif
 
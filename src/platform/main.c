@@ -1,5 +1,11 @@
+#include <dirent.h>
+#include <unistd.h>
 #include "platform.h"
 
+#ifdef BROGUE_CURSES
+#include "term.h"
+#endif
+
 #ifdef BROGUE_TCOD
 #include "libtcod.h"
 TCOD_renderer_t renderer = TCOD_RENDERER_SDL; // the sdl renderer is more reliable than the opengl renderer
@@ -23,6 +29,35 @@ boolean serverMode = false;
 boolean noMenu = false;
 unsigned long int firstSeed = 0;
 
+// headless seed catalog (--scum)
+boolean scumRequested = false;
+unsigned long int scumFirstSeed = 1;
+int scumSeedCount = 1000;
+int scumDepth = 5;
+
+// headless recording verification (--verify)
+char **verifyPaths = NULL;
+int verifyPathCount = 0;
+
+int workerJobs = 0; // for --scum and --verify; 0 means one per processor
+
+// headless pathing and cell appearance benchmarks (--bench-dijkstra, --bench-cell-appearance)
+boolean benchRequested = false;
+unsigned long int benchFirstSeed = 1;
+int benchSeedCount = 10;
+int benchDepth = 10;
+int benchAppearanceTurns = 0;
+int benchRepairSequences = 0;
+long benchKernelCalls = 0;
+
+// headless drawing benchmark (--benchmark)
+boolean drawBenchRequested = false;
+
+#ifdef BROGUE_CURSES
+// terminal color coercion benchmark (--bench-term-colors)
+long benchColorCells = 0;
+#endif
+
 void dumpScores();
 
 static boolean endswith(const char *str, const char *ending)
@@ -38,6 +73,38 @@ static void append(char *str, char *ending, int bufsize) {
 	strcpy(str + str_len, ending);
 }
 
+static void addVerifyPath(const char *path) {
+	verifyPaths = realloc(verifyPaths, sizeof(char *) * (verifyPathCount + 1));
+	verifyPaths[verifyPathCount++] = strdup(path);
+}
+
+static int comparePaths(const void *a, const void *b) {
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+// a directory stands for every recording directly inside it, in name order
+static void addVerifyPaths(const char *path) {
+	char recordingPath[BROGUE_FILENAME_MAX];
+	struct dirent *ep;
+	DIR *dp;
+	int first;
+
+	dp = opendir(path);
+	if (dp == NULL) {
+		addVerifyPath(path);
+		return;
+	}
+	first = verifyPathCount;
+	while ((ep = readdir(dp)) != NULL) {
+		if (endswith(ep->d_name, RECORDING_SUFFIX)) {
+			snprintf(recordingPath, BROGUE_FILENAME_MAX, "%s/%s", path, ep->d_name);
+			addVerifyPath(recordingPath);
+		}
+	}
+	closedir(dp);
+	qsort(verifyPaths + first, verifyPathCount - first, sizeof(char *), comparePaths);
+}
+
 static void printCommandlineHelp() {
 	printf("%s", 
 	"--help         -h          print this help message\n"
@@ -48,13 +115,33 @@ static void printCommandlineHelp() {
 	"-s seed                    start a new game with the specified numerical seed\n"
 	"-o filename[.broguesave]   open a save file (extension optional)\n"
 	"-v recording[.broguerec]   view a recording (extension optional)\n"
+	"--scum seed count depth    write the seed catalog for count seeds from seed, through depth, and exit\n"
+	"--verify path              replay a recording, or every recording in a directory, without a display;\n"
+	"                           report any that go out of sync, and exit (may be given more than once)\n"
+	"--jobs N       -j N        number of worker threads for --scum and --verify (default: one per processor)\n"
+	"--bench-dijkstra seed count depth\n"
+	"                           time distance map scans on the levels of count seeds from seed, through depth,\n"
+	"                           and exit\n"
+	"--bench-dijkstra-repair seed count\n"
+	"                           check repaired distance maps against full scans over count sequences of\n"
+	"                           random map edits from seed, time both, and exit (1 12000 is thorough)\n"
+	"--bench-grid-kernels calls\n"
+	"                           time each whole-grid kernel that many times in every instruction set the\n"
+	"                           processor has, check them against the scalar ones, and exit\n"
+	"--bench-cell-appearance seed count depth turns\n"
+	"                           time whole-map redraws with and without the cell appearance cache after\n"
+	"                           each of that many turns on the same levels, and exit\n"
 #ifdef BROGUE_TCOD
 	"--size N                   starts the game at font size N (1 to 13)\n"
 	"--noteye-hack              ignore SDL-specific application state checks\n"
 #endif
 	"--no-menu      -M          never display the menu (automatically pick new game)\n"
+	"--headless                 run without a display or delays, taking keystrokes from standard input\n"
+	"                           and quitting when it runs out\n"
+	"--benchmark                time 500 screens of drawing without a display, and exit\n"
 #ifdef BROGUE_CURSES
 	"--term         -t          run in ncurses-based terminal mode\n"
+	"--bench-term-colors cells  time the 16-color terminal's color matching over that many cells, and exit\n"
 #endif
 #ifdef BROGUE_TCOD
 	"--SDL                      force libtcod mode with an SDL renderer (default)\n"
@@ -102,6 +189,86 @@ int main(int argc, char *argv[])
 			}
 		}
 
+		if (strcmp(argv[i], "--scum") == 0) {
+			if (i + 3 < argc) {
+				scumFirstSeed = atof(argv[i + 1]);
+				scumSeedCount = atoi(argv[i + 2]);
+				scumDepth = atoi(argv[i + 3]);
+				if (scumFirstSeed != 0 && scumSeedCount > 0 && scumDepth > 0 && scumDepth <= DEEPEST_LEVEL) {
+					i += 3;
+					scumRequested = true;
+					continue;
+				}
+			}
+		}
+
+		if (strcmp(argv[i], "--bench-dijkstra") == 0) {
+			if (i + 3 < argc) {
+				benchFirstSeed = atof(argv[i + 1]);
+				benchSeedCount = atoi(argv[i + 2]);
+				benchDepth = atoi(argv[i + 3]);
+				if (benchFirstSeed != 0 && benchSeedCount > 0 && benchDepth > 0 && benchDepth <= DEEPEST_LEVEL) {
+					i += 3;
+					benchRequested = true;
+					continue;
+				}
+			}
+		}
+
+		if (strcmp(argv[i], "--bench-dijkstra-repair") == 0) {
+			if (i + 2 < argc) {
+				benchFirstSeed = atof(argv[i + 1]);
+				benchRepairSequences = atoi(argv[i + 2]);
+				if (benchFirstSeed != 0 && benchRepairSequences > 0) {
+					i += 2;
+					continue;
+				}
+			}
+		}
+
+		if (strcmp(argv[i], "--bench-grid-kernels") == 0) {
+			if (i + 1 < argc) {
+				benchKernelCalls = atol(argv[i + 1]);
+				if (benchKernelCalls > 0) {
+					i++;
+					continue;
+				}
+			}
+		}
+
+		if (strcmp(argv[i], "--bench-cell-appearance") == 0) {
+			if (i + 4 < argc) {
+				benchFirstSeed = atof(argv[i + 1]);
+				benchSeedCount = atoi(argv[i + 2]);
+				benchDepth = atoi(argv[i + 3]);
+				benchAppearanceTurns = atoi(argv[i + 4]);
+				if (benchFirstSeed != 0 && benchSeedCount > 0 && benchDepth > 0 && benchDepth <= DEEPEST_LEVEL
+					&& benchAppearanceTurns > 0) {
+					i += 4;
+					continue;
+				}
+			}
+		}
+
+		if (strcmp(argv[i], "--verify") == 0) {
+			if (i + 1 < argc) {
+				addVerifyPaths(argv[i + 1]);
+				i++;
+				continue;
+			}
+		}
+
+		if (strcmp(argv[i], "--jobs") == 0 || strcmp(argv[i], "-j") == 0) {
+			if (i + 1 < argc) {
+				int jobs = atoi(argv[i + 1]);
+				if (jobs > 0) {
+					i++;
+					workerJobs = jobs;
+					continue;
+				}
+			}
+		}
+
 		if(strcmp(argv[i], "-n") == 0) {
 			if (rogue.nextGameSeed == 0) {
 				rogue.nextGame = NG_NEW_GAME;
@@ -188,11 +355,28 @@ int main(int argc, char *argv[])
 			}
 		}
 #endif
+		if (strcmp(argv[i], "--headless") == 0) {
+			currentConsole = nullConsole;
+			continue;
+		}
+
+		if (strcmp(argv[i], "--benchmark") == 0) {
+			drawBenchRequested = true;
+			continue;
+		}
+
 #ifdef BROGUE_CURSES
 		if (strcmp(argv[i], "--term") == 0 || strcmp(argv[i], "-t") == 0) {
 			currentConsole = cursesConsole;
 			continue;
 		}
+		if (strcmp(argv[i], "--bench-term-colors") == 0) {
+			if (i + 1 < argc && atol(argv[i + 1]) > 0) {
+				benchColorCells = atol(argv[i + 1]);
+				i++;
+				continue;
+			}
+		}
 #endif
 
 		// maybe it ends with .broguesave or .broguerec, then?
@@ -214,6 +398,59 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 	
+	if (workerJobs == 0) {
+		workerJobs = max(1, sysconf(_SC_NPROCESSORS_ONLN));
+	}
+
+	if (scumRequested) {
+		// no console is needed; fast-forwarding keeps the scan from drawing anything
+		rogue.playbackFastForward = true;
+		scum(scumFirstSeed, scumSeedCount, scumDepth, workerJobs);
+		printf("\n");
+		return 0;
+	}
+
+	if (benchRequested) {
+		rogue.playbackFastForward = true;
+		return benchmarkDijkstra(benchFirstSeed, benchSeedCount, benchDepth, stdout) > 0 ? 1 : 0;
+	}
+
+	if (benchRepairSequences > 0) {
+		return benchmarkDijkstraRepair(benchFirstSeed, benchRepairSequences, stdout) > 0 ? 1 : 0;
+	}
+
+	if (benchKernelCalls > 0) {
+		return benchmarkGridKernels(benchKernelCalls, stdout) > 0 ? 1 : 0;
+	}
+
+	if (drawBenchRequested) {
+		// always headless; the other consoles aren't set up until their game loop starts
+		currentConsole = nullConsole;
+		benchmark();
+		return 0;
+	}
+
+	if (benchAppearanceTurns > 0) {
+		rogue.playbackFastForward = true;
+		return benchmarkCellAppearance(benchFirstSeed, benchSeedCount, benchDepth, benchAppearanceTurns, stdout) > 0 ? 1 : 0;
+	}
+
+#ifdef BROGUE_CURSES
+	if (benchColorCells > 0) {
+		return term_benchmark_colors(benchColorCells, stdout) > 0 ? 1 : 0;
+	}
+#endif
+
+	if (verifyPathCount > 0) {
+		// likewise; every worker replays fast-forwarded and headless
+		int failures = verifyRecordings(verifyPaths, verifyPathCount, workerJobs, stdout);
+		for (i = 0; i < verifyPathCount; i++) {
+			free(verifyPaths[i]);
+		}
+		free(verifyPaths);
+		return failures > 0 ? 1 : 0;
+	}
+
 	loadKeymap();
 	currentConsole.gameLoop();
 	
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include "IncludeGlobals.h" // first, for the standard headers it has to include ahead of Rogue.h
+#include "platform.h"
+
+// A console with no display: nothing is drawn, nothing is waited for, and
+// keystrokes come one byte at a time from standard input, so that recordings,
+// bots and benchmarks can run without a terminal or SDL. The game is told to
+// quit once the input runs out.
+
+static void gameLoop() {
+	rogueMain();
+}
+
+static bool null_pauseForMilliseconds(int milliseconds) {
+	return false;
+}
+
+static void null_nextKeyOrMouseEvent(RogueEvent *returnEvent, bool textInput, bool colorsDance) {
+	int key;
+
+	if (noMenu && rogue.nextGame == NG_NOTHING) rogue.nextGame = NG_NEW_GAME;
+
+	key = getchar();
+	if (key == EOF) {
+		rogue.gameHasEnded = true; // causes the game loop to terminate quickly
+		rogue.nextGame = NG_QUIT; // and the menu to drop out immediately
+		key = ACKNOWLEDGE_KEY;
+	} else if (key == '\n') {
+		key = RETURN_KEY;
+	}
+
+	returnEvent->eventType = KEYSTROKE;
+	returnEvent->param1 = key;
+	returnEvent->param2 = 0;
+	returnEvent->controlKey = 0;
+	returnEvent->shiftKey = (key >= 'A' && key <= 'Z');
+}
+
+static void null_plotChar(uchar ch,
+			  short xLoc, short yLoc,
+			  short foreRed, short foreGreen, short foreBlue,
+			  short backRed, short backGreen, short backBlue) {
+}
+
+static void null_plotRun(short xLoc, short yLoc, short length, const cellDisplayBuffer *cells) {
+}
+
+static void null_remap(const char *input_name, const char *output_name) {
+}
+
+static bool modifier_held(int modifier) {
+	return 0;
+}
+
+struct brogueConsole nullConsole = {
+	gameLoop,
+	null_pauseForMilliseconds,
+	null_nextKeyOrMouseEvent,
+	null_plotChar,
+	null_remap,
+	modifier_held,
+	null_plotRun
+};
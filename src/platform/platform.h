@@ -7,10 +7,13 @@ struct brogueConsole {
 	void (*plotChar)(uchar, short, short, short, short, short, short, short, short);
 	void (*remap)(const char *, const char *);
 	bool (*modifierHeld)(int modifier);
+	void (*plotRun)(short xLoc, short yLoc, short length, const cellDisplayBuffer *cells); // optional; NULL plots each cell with plotChar
 };
 
 void loadKeymap();
 
+extern struct brogueConsole nullConsole;
+
 #ifdef BROGUE_TCOD
 extern struct brogueConsole tcodConsole;
 #endif
@@ -51,6 +51,21 @@ void plotChar(uchar inputChar,
 	currentConsole.plotChar(inputChar, xLoc, yLoc, foreRed, foreGreen, foreBlue, backRed, backGreen, backBlue);
 }
 
+// length cells of row yLoc, from xLoc rightward
+void plotCharRun(int xLoc, int yLoc, int length, const cellDisplayBuffer *cells) {
+	int i;
+
+	if (currentConsole.plotRun) {
+		currentConsole.plotRun(xLoc, yLoc, length, cells);
+		return;
+	}
+	for (i = 0; i < length; i++) {
+		currentConsole.plotChar(cells[i].character, xLoc + i, yLoc,
+			cells[i].foreColorComponents[0], cells[i].foreColorComponents[1], cells[i].foreColorComponents[2],
+			cells[i].backColorComponents[0], cells[i].backColorComponents[1], cells[i].backColorComponents[2]);
+	}
+}
+
 void pausingTimerStartsNow() {
 	
 }
@@ -76,21 +76,7 @@ static void gameLoop()
 	TCOD_console_delete(NULL);
 }
 
-static void tcod_plotChar(uchar inputChar,
-			  short xLoc, short yLoc,
-			  short foreRed, short foreGreen, short foreBlue,
-			  short backRed, short backGreen, short backBlue) {
-	
-	TCOD_color_t fore;
-	TCOD_color_t back;
-	
-	fore.r = (uint8) foreRed * 255 / 100;
-	fore.g = (uint8) foreGreen * 255 / 100;
-	fore.b = (uint8) foreBlue * 255 / 100;
-	back.r = (uint8) backRed * 255 / 100;
-	back.g = (uint8) backGreen * 255 / 100;
-	back.b = (uint8) backBlue * 255 / 100;
-	
+static int tcod_glyph(uchar inputChar) {
 	if (inputChar == STATUE_CHAR) {
 		inputChar = 223;
 	} else if (inputChar > 255) {
@@ -126,7 +112,46 @@ static void tcod_plotChar(uchar inputChar,
 			default: inputChar = '?'; break;
 		}
 	}
-	TCOD_console_put_char_ex(NULL, xLoc, yLoc, (int) inputChar, fore, back);
+	return (int) inputChar;
+}
+
+static void tcod_plotChar(uchar inputChar,
+			  short xLoc, short yLoc,
+			  short foreRed, short foreGreen, short foreBlue,
+			  short backRed, short backGreen, short backBlue) {
+	
+	TCOD_color_t fore;
+	TCOD_color_t back;
+	
+	fore.r = (uint8) foreRed * 255 / 100;
+	fore.g = (uint8) foreGreen * 255 / 100;
+	fore.b = (uint8) foreBlue * 255 / 100;
+	back.r = (uint8) backRed * 255 / 100;
+	back.g = (uint8) backGreen * 255 / 100;
+	back.b = (uint8) backBlue * 255 / 100;
+	
+	TCOD_console_put_char_ex(NULL, xLoc, yLoc, tcod_glyph(inputChar), fore, back);
+}
+
+// neighbouring cells often share colors, so only convert them when they change
+static void tcod_plotRun(short xLoc, short yLoc, short length, const cellDisplayBuffer *cells) {
+	TCOD_color_t fore, back;
+	int i;
+
+	for (i = 0; i < length; i++) {
+		const char *f = cells[i].foreColorComponents, *b = cells[i].backColorComponents;
+		if (i == 0 || memcmp(f, cells[i - 1].foreColorComponents, 3)) {
+			fore.r = (uint8) f[0] * 255 / 100;
+			fore.g = (uint8) f[1] * 255 / 100;
+			fore.b = (uint8) f[2] * 255 / 100;
+		}
+		if (i == 0 || memcmp(b, cells[i - 1].backColorComponents, 3)) {
+			back.r = (uint8) b[0] * 255 / 100;
+			back.g = (uint8) b[1] * 255 / 100;
+			back.b = (uint8) b[2] * 255 / 100;
+		}
+		TCOD_console_put_char_ex(NULL, xLoc + i, yLoc, tcod_glyph(cells[i].character), fore, back);
+	}
 }
 
 static void initWithFont(int fontSize)
@@ -638,7 +663,8 @@ struct brogueConsole tcodConsole = {
 	tcod_nextKeyOrMouseEvent,
 	tcod_plotChar,
 	tcod_remap,
-	modifier_held
+	modifier_held,
+	tcod_plotRun
 };
 
 #endif
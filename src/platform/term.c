@@ -4,6 +4,9 @@
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
 
 
 // As a rule, everything in term.c is the result of gradual evolutionary
@@ -45,9 +48,22 @@ pairmode_cell *cell_buffer;
 
 enum {
 	coerce_16,
-	coerce_256
+	coerce_256,
+	direct_rgb
 } colormode;
 
+
+// truecolor mode stuff: the game draws into rgb_back, rgb_front is what the
+// terminal is showing, and a refresh sends the difference in one write()
+typedef struct {
+	int ch;
+	int fore, back; // 0xRRGGBB
+} rgb_cell;
+
+rgb_cell *rgb_back, *rgb_front;
+
+char *rgb_out;
+
 int is_xterm;
 
 
@@ -73,6 +89,12 @@ static void preparecolor ( ) {
 	if (COLORS >= 256) {
 		colormode = coerce_256;
 	}
+
+	// ncurses has no way to ask for 24-bit color, so go by what the terminal advertises
+	char *colorterm = getenv("COLORTERM");
+	if (colorterm && (strcmp(colorterm, "truecolor") == 0 || strcmp(colorterm, "24bit") == 0)) {
+		colormode = direct_rgb;
+	}
 }
 
 static void term_title(const char *title) {
@@ -310,9 +332,12 @@ static void init_coersion() {
 	}
 
 	cell_buffer = 0;
+	rgb_back = 0;
+	rgb_front = 0;
+	rgb_out = 0;
 }
 
-static int best (fcolor *fg, fcolor *bg) {
+static int best_direct (fcolor *fg, fcolor *bg) {
 	// analyze fg & bg for their contrast
 	CIE cieFg = toCIE(*fg);
 	CIE cieBg = toCIE(*bg);
@@ -372,6 +397,95 @@ static int best (fcolor *fg, fcolor *bg) {
 	}
 }
 
+// Brogue's colors come to us as whole percentages, so there are only 101^3 of
+// them, and each one's place in the palette can be worked out once and kept.
+// Anything else (there shouldn't be anything else) goes through best_direct().
+
+#define LEVELS 101
+
+typedef struct {
+	Lab lab;
+	unsigned char fg, bg; // nearest in the low nibble, second nearest in the high
+	unsigned char filled;
+} quantized;
+
+static quantized *quantized_planes[LEVELS]; // by red, allocated as they're needed
+
+static int color_level(float f) {
+	int k = f * 100 + .5;
+	if (k < 0 || k >= LEVELS || (float) k / 100 != f) return -1;
+	return k;
+}
+
+static void rank_palette(Lab *lab, int count, unsigned char *ranked) {
+	float big = 100000000;
+	int c1 = 0, c2 = 0;
+	float c1_score = big, c2_score = big;
+
+	int i;
+	for (i = 0; i < count; i++) {
+		float s = CIE76(labPalette + i, lab);
+
+		if (s < c2_score) {
+			if (s < c1_score) {
+				c2 = c1; c1 = i;
+				c2_score = c1_score; c1_score = s;
+			} else {
+				c2 = i; c2_score = s;
+			}
+		}
+	}
+
+	*ranked = c1 | (c2 << 4);
+}
+
+static quantized *quantize(fcolor *c) {
+	int r = color_level(c->r), g = color_level(c->g), b = color_level(c->b);
+	if (r < 0 || g < 0 || b < 0) return NULL;
+
+	if (!quantized_planes[r]) {
+		quantized_planes[r] = calloc(LEVELS * LEVELS, sizeof(quantized));
+		if (!quantized_planes[r]) return NULL;
+	}
+
+	quantized *q = &quantized_planes[r][g * LEVELS + b];
+	if (!q->filled) {
+		CIE cie = toCIE(*c);
+		q->lab = toLab(&cie);
+		rank_palette(&q->lab, 16, &q->fg);
+		rank_palette(&q->lab, 8, &q->bg);
+		q->filled = 1;
+	}
+	return q;
+}
+
+// the same choice as best_direct(), from the table
+static int best (fcolor *fg, fcolor *bg) {
+	quantized *qf = quantize(fg), *qb = quantize(bg);
+	if (!qf || !qb) return best_direct(fg, bg);
+
+	float JND = 2.3; // just-noticeable-difference
+	int areTheSame = CIE76(&qf->lab, &qb->lab) <= 2.0 * JND; // a little extra fudge
+
+	int bg1 = qb->bg & 0x0f, bg2 = qb->bg >> 4;
+	if (areTheSame) {
+		return COLORING(bg1, bg1);
+	}
+
+	int fg1 = qf->fg & 0x0f, fg2 = qf->fg >> 4;
+	if (fg1 != bg1) {
+		return COLORING (fg1, bg1);
+	} else {
+		float fg1_score = CIE76(labPalette + fg1, &qf->lab), fg2_score = CIE76(labPalette + fg2, &qf->lab);
+		float bg1_score = CIE76(labPalette + bg1, &qb->lab), bg2_score = CIE76(labPalette + bg2, &qb->lab);
+		if (fg1_score + bg2_score < fg2_score + bg1_score) {
+			return COLORING(fg1, bg2);
+		} else {
+			return COLORING(fg2, bg1);
+		}
+	}
+}
+
 static int coerce (fcolor *color, float dark, float saturation, float brightcut, float grey) {
 	float bright = color->r;
 	if (color->g > bright) bright = color->g;
@@ -566,6 +680,115 @@ static void buffer_render_256() {
 	}
 }
 
+static int rgb_channel(float f) {
+	int c = f * 255 + .5;
+	return c < 0 ? 0 : c > 255 ? 255 : c;
+}
+
+static int rgb_pack(fcolor *f) {
+	return (rgb_channel(f->r) << 16) | (rgb_channel(f->g) << 8) | rgb_channel(f->b);
+}
+
+static void buffer_plot_rgb(int ch, int x, int y, fcolor *fg, fcolor *bg) {
+	int cell = x + y * minsize.width;
+	rgb_back[cell].ch = (ch < ' ' || ch > 126) ? ' ' : ch;
+	rgb_back[cell].fore = rgb_pack(fg);
+	rgb_back[cell].back = rgb_pack(bg);
+}
+
+static char *rgb_number(char *out, int n) {
+	if (n >= 100) *out++ = '0' + n / 100;
+	if (n >= 10) *out++ = '0' + n / 10 % 10;
+	*out++ = '0' + n % 10;
+	return out;
+}
+
+static char *rgb_color(char *out, int color) {
+	out = rgb_number(out, (color >> 16) & 0xff);
+	*out++ = ';';
+	out = rgb_number(out, (color >> 8) & 0xff);
+	*out++ = ';';
+	return rgb_number(out, color & 0xff);
+}
+
+// the most a single cell can cost: a cursor move, both colors and the character
+#define RGB_CELL_BYTES 64
+
+static void buffer_render_rgb() {
+	char *out = rgb_out;
+	int fore = -1, back = -1; // what the terminal will draw with; unknown at first
+	int cx = -1, cy = -1; // where the terminal's cursor is
+	int i = 0, x, y;
+
+	for (y = 0; y < minsize.height; y++) {
+		for (x = 0; x < minsize.width; x++, i++) {
+			rgb_cell *cell = &rgb_back[i];
+			if (cell->ch == rgb_front[i].ch && cell->fore == rgb_front[i].fore && cell->back == rgb_front[i].back) {
+				continue;
+			}
+
+			if (x != cx || y != cy) {
+				*out++ = '\033';
+				*out++ = '[';
+				out = rgb_number(out, y + 1);
+				*out++ = ';';
+				out = rgb_number(out, x + 1);
+				*out++ = 'H';
+			}
+
+			if (cell->fore != fore || cell->back != back) {
+				*out++ = '\033';
+				*out++ = '[';
+				if (cell->fore != fore) {
+					*out++ = '3'; *out++ = '8'; *out++ = ';'; *out++ = '2'; *out++ = ';';
+					out = rgb_color(out, cell->fore);
+					if (cell->back != back) *out++ = ';';
+				}
+				if (cell->back != back) {
+					*out++ = '4'; *out++ = '8'; *out++ = ';'; *out++ = '2'; *out++ = ';';
+					out = rgb_color(out, cell->back);
+				}
+				*out++ = 'm';
+				fore = cell->fore;
+				back = cell->back;
+			}
+
+			*out++ = cell->ch;
+			rgb_front[i] = *cell;
+			cx = x + 1;
+			cy = y;
+		}
+	}
+
+	if (out == rgb_out) return;
+
+	// leave the attributes as ncurses expects to find them
+	*out++ = '\033';
+	*out++ = '[';
+	*out++ = '0';
+	*out++ = 'm';
+
+	fflush(stdout); // anything printf()ed, like the title, goes first
+
+	char *p = rgb_out;
+	while (p < out) {
+		ssize_t written = write(STDOUT_FILENO, p, out - p);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		p += written;
+	}
+}
+
+static void buffer_forget_rgb() {
+	// the terminal's contents are unknown; send everything next refresh
+	int i;
+	for (i = 0; i < minsize.width * minsize.height; i++) {
+		rgb_front[i].ch = -1;
+	}
+}
+
 static void term_mvaddch(int x, int y, int ch, fcolor *fg, fcolor *bg) {
 	if (x < 0 || y < 0 || x >= minsize.width || y >= minsize.height) return;
 
@@ -573,6 +796,8 @@ static void term_mvaddch(int x, int y, int ch, fcolor *fg, fcolor *bg) {
 		int c = best(fg, bg);
 		attrset(COLOR_ATTR(c));
 		mvaddch(y, x, ch);
+	} else if (colormode == direct_rgb) {
+		buffer_plot_rgb(ch, x, y, fg, bg);
 	} else {
 		buffer_plot(ch, x, y, fg, bg);
 	}
@@ -607,6 +832,8 @@ static void term_refresh() {
 
 	if (colormode == coerce_256) {
 		buffer_render_256();
+	} else if (colormode == direct_rgb) {
+		buffer_render_rgb();
 	}
 
 	refresh();
@@ -694,6 +921,14 @@ static void ensure_size( ) {
 		erase();
 		refresh();
 	}
+
+	if (colormode == direct_rgb && rgb_front) {
+		// ncurses doesn't know what our writes left on the screen, so have it
+		// clear the screen outright, and repaint the whole game afterwards
+		clearok(curscr, TRUE);
+		refresh();
+		buffer_forget_rgb();
+	}
 }
 
 static void term_resize(int w, int h) {
@@ -722,6 +957,17 @@ static void term_resize(int w, int h) {
 		cell_buffer[i].fore.idx = 0;
 		cell_buffer[i].back.idx = 0;
 	}
+
+	if (rgb_back) free(rgb_back);
+	if (rgb_front) free(rgb_front);
+	if (rgb_out) free(rgb_out);
+	rgb_back = calloc(w * h, sizeof(rgb_cell));
+	rgb_front = malloc(sizeof(rgb_cell) * w * h);
+	rgb_out = malloc(RGB_CELL_BYTES * w * h + 4);
+	for (i = 0; i < w * h; i++) {
+		rgb_back[i].ch = ' '; // black blanks until the game draws there, never NUL bytes
+	}
+	buffer_forget_rgb();
 }
 
 static void term_wait(int ms) {
@@ -869,6 +1115,60 @@ int term_keycodeByName(const char *name) {
 }
 
 
+static double bench_seconds() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+#define BENCH_COLORS 4096
+
+// Pushes cells pairs of whole-percent colors through the 16-color coercion,
+// both the direct way and through the table, and writes cells/sec for each to
+// report. Returns how many answers the two ways disagreed on,
+// which should always be zero.
+long term_benchmark_colors(long cells, FILE *report) {
+	static fcolor colors[BENCH_COLORS];
+	long i, mismatches = 0;
+	int sink = 0;
+	double start, direct16, table16;
+
+	init_coersion();
+	srand(1);
+	for (i = 0; i < BENCH_COLORS; i++) {
+		colors[i].r = (float) (rand() % LEVELS) / 100;
+		colors[i].g = (float) (rand() % LEVELS) / 100;
+		colors[i].b = (float) (rand() % LEVELS) / 100;
+	}
+
+	start = bench_seconds();
+	for (i = 0; i < cells; i++) {
+		sink += best_direct(&colors[i % BENCH_COLORS], &colors[(i * 7 + 1) % BENCH_COLORS]);
+	}
+	direct16 = bench_seconds() - start;
+
+	start = bench_seconds();
+	for (i = 0; i < cells; i++) {
+		sink -= best(&colors[i % BENCH_COLORS], &colors[(i * 7 + 1) % BENCH_COLORS]);
+	}
+	table16 = bench_seconds() - start;
+
+	// check every answer, not just the sums
+	for (i = 0; i < BENCH_COLORS * 8; i++) {
+		fcolor *fg = &colors[i % BENCH_COLORS], *bg = &colors[(i * 7 + 1) % BENCH_COLORS];
+		if (best_direct(fg, bg) != best(fg, bg)) {
+			mismatches++;
+		}
+	}
+	if (sink) mismatches++;
+
+	fprintf(report, "# %li cells, %i distinct colors\n", cells, BENCH_COLORS);
+	fprintf(report, "16 colors  direct %12.0f cells/sec  table %12.0f cells/sec  %6.2fx\n",
+		cells / direct16, cells / table16, direct16 / table16);
+	fprintf(report, "%li mismatched\n", mismatches);
+	return mismatches;
+}
+
 struct term_t Term = {
 	term_start,
 	term_end,
@@ -2,6 +2,8 @@
 #ifndef _term_h_
 #define _term_h_
 
+#include <stdio.h>
+
 #define TERM_NONE 0
 #define TERM_MOUSE 1
 
@@ -32,5 +34,7 @@ struct term_t {
 
 extern struct term_t Term;
 
+long term_benchmark_colors(long cells, FILE *report);
+
 #endif
 